@@ -0,0 +1,99 @@
+#include "index_buffer.h"
+
+#include "glm/common.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define INDEX_BUFFER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+uint32 meshIndexSize(const Mesh& mesh)
+{
+	return mesh.vertexCount() <= maxIndex16Vertices ? sizeof(uint16_t) : sizeof(uint32);
+}
+
+void packIndices16(const uint32* indices, uint32 count, uint16_t* out)
+{
+	uint32 i = 0;
+#ifdef INDEX_BUFFER_SSE2
+	// sse2 only has a signed saturating pack, so shift into signed range,
+	// pack, and shift back
+	const __m128i bias = _mm_set1_epi32(32768);
+	const __m128i flip = _mm_set1_epi16((short)0x8000);
+	for (; i + 8 <= count; i += 8) {
+		__m128i a = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(indices + i)), bias);
+		__m128i b = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(indices + i + 4)), bias);
+		_mm_storeu_si128((__m128i*)(out + i), _mm_xor_si128(_mm_packs_epi32(a, b), flip));
+	}
+#endif
+	for (; i < count; ++i) {
+		out[i] = (uint16_t)indices[i];
+	}
+}
+
+void splitMeshForIndex16(const Mesh& mesh, std::vector<Mesh>& parts)
+{
+	uint32 vertexCount = (uint32)mesh.verts.size();
+	uint32 triCount = (uint32)(mesh.triangles.size() / 3);
+
+	glm::vec3 minBounds(FLT_MAX);
+	glm::vec3 maxBounds(-FLT_MAX);
+	for (uint32 v = 0; v < vertexCount; ++v) {
+		minBounds = glm::min(minBounds, mesh.verts[v].location);
+		maxBounds = glm::max(maxBounds, mesh.verts[v].location);
+	}
+	glm::vec3 extent = maxBounds - minBounds;
+	int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+
+	// triangles with out of range indices can't go in any part
+	std::vector<uint32> order;
+	std::vector<float> keys(triCount);
+	order.reserve(triCount);
+	for (uint32 t = 0; t < triCount; ++t) {
+		const uint32* tri = &mesh.triangles[t * 3];
+		if (tri[0] < vertexCount && tri[1] < vertexCount && tri[2] < vertexCount) {
+			keys[t] = mesh.verts[tri[0]].location[axis] + mesh.verts[tri[1]].location[axis] + mesh.verts[tri[2]].location[axis];
+			order.push_back(t);
+		}
+	}
+	std::stable_sort(order.begin(), order.end(), [&](uint32 a, uint32 b) {
+		return keys[a] < keys[b];
+	});
+
+	// vertex index in the current part, stamped with the part so nothing
+	// has to be cleared between parts
+	const uint32 noPart = ~0u;
+	std::vector<uint32> partOf(vertexCount, noPart);
+	std::vector<uint32> local(vertexCount);
+	size_t firstPart = parts.size();
+	Mesh* part = 0;
+	uint32 partId = 0;
+	for (size_t i = 0; i < order.size(); ++i) {
+		const uint32* tri = &mesh.triangles[order[i] * 3];
+		uint32 added = 0;
+		for (int k = 0; k < 3; ++k) {
+			added += partOf[tri[k]] != partId && (k < 1 || tri[k] != tri[0]) && (k < 2 || tri[k] != tri[1]);
+		}
+		if (!part || part->verts.size() + added > maxIndex16Vertices) {
+			partId = (uint32)(parts.size() - firstPart);
+			parts.push_back(Mesh());
+			part = &parts.back();
+			char suffix[16];
+			snprintf(suffix, sizeof(suffix), ".%d", partId);
+			part->name = mesh.name + suffix;
+		}
+		for (int k = 0; k < 3; ++k) {
+			uint32 v = tri[k];
+			if (partOf[v] != partId) {
+				partOf[v] = partId;
+				local[v] = (uint32)part->verts.size();
+				part->verts.push_back(mesh.verts[v]);
+			}
+			part->triangles.push_back(local[v]);
+		}
+	}
+}
@@ -0,0 +1,31 @@
+#ifndef INDEX_BUFFER_H
+#define INDEX_BUFFER_H
+
+#include "main.h"
+
+#include <vector>
+
+// meshes with at most this many vertices are drawn with 16 bit indices
+const uint32 maxIndex16Vertices = 1 << 16;
+
+/**
+ * @brief Bytes per index the renderer uses for a mesh, 2 when every vertex
+ * fits in 16 bits.
+ */
+uint32 meshIndexSize(const Mesh& mesh);
+
+/**
+ * @brief Writes indices as 16 bits, the caller makes sure they fit.
+ */
+void packIndices16(const uint32* indices, uint32 count, uint16_t* out);
+
+/**
+ * @brief Splits a mesh into parts of at most maxIndex16Vertices vertices
+ * so each can use 16 bit indices. Triangles are taken in slabs along the
+ * longest axis of the mesh so the parts stay compact, vertices on the cut
+ * are duplicated. Anything derived from the triangles (lods, meshlets) is
+ * left out, so this is meant to run before the rest of the mesh pipeline.
+ */
+void splitMeshForIndex16(const Mesh& mesh, std::vector<Mesh>& parts);
+
+#endif // INDEX_BUFFER_H
@@ -0,0 +1,92 @@
+#include "index_map.h"
+
+// marks an empty slot, no mesh gets anywhere near 2^32 vertices
+static const uint32 emptySlot = 0xFFFFFFFF;
+
+static inline uint32 hashIndices(int32 vertex, int32 normal, int32 texcoord)
+{
+	uint32 h = (uint32)vertex * 0x9E3779B1u;
+	h ^= (uint32)normal * 0x85EBCA77u;
+	h ^= (uint32)texcoord * 0xC2B2AE3Du;
+	h ^= h >> 15;
+	h *= 0x27D4EB2Fu;
+	h ^= h >> 13;
+	return h;
+}
+
+static size_t slotCountFor(size_t count)
+{
+	// keep the load factor at or below one half
+	size_t slots = 16;
+	while (slots < count * 2) {
+		slots *= 2;
+	}
+	return slots;
+}
+
+static void clearSlots(std::vector<IndexMapSlot>& slots, size_t slotCount)
+{
+	IndexMapSlot empty = { 0, 0, 0, emptySlot };
+	slots.assign(slotCount, empty);
+}
+
+void resetIndexMap(IndexMap& map, size_t expectedCount)
+{
+	// assign keeps the old allocation when it is big enough, but only the
+	// slots needed for this shape are cleared and probed
+	clearSlots(map.slots, slotCountFor(expectedCount));
+	map.count = 0;
+}
+
+static void growIndexMap(IndexMap& map)
+{
+	std::vector<IndexMapSlot> old;
+	old.swap(map.slots);
+	clearSlots(map.slots, old.size() * 2);
+	size_t mask = map.slots.size() - 1;
+	for (size_t i = 0; i < old.size(); ++i) {
+		const IndexMapSlot& slot = old[i];
+		if (slot.value == emptySlot) {
+			continue;
+		}
+		size_t s = hashIndices(slot.vertex, slot.normal, slot.texcoord) & mask;
+		while (map.slots[s].value != emptySlot) {
+			s = (s + 1) & mask;
+		}
+		map.slots[s] = slot;
+	}
+}
+
+uint32 findOrAddIndex(IndexMap& map, int32 vertex, int32 normal, int32 texcoord, uint32 newValue, bool& added)
+{
+	if (map.slots.empty() || (map.count + 1) * 2 > map.slots.size()) {
+		if (map.slots.empty()) {
+			resetIndexMap(map, 0);
+		}
+		else {
+			growIndexMap(map);
+		}
+	}
+
+	// linear probing, the slots are small so a probe sequence stays within
+	// a cache line or two
+	size_t mask = map.slots.size() - 1;
+	size_t s = hashIndices(vertex, normal, texcoord) & mask;
+	while (true) {
+		IndexMapSlot& slot = map.slots[s];
+		if (slot.value == emptySlot) {
+			slot.vertex = vertex;
+			slot.normal = normal;
+			slot.texcoord = texcoord;
+			slot.value = newValue;
+			map.count++;
+			added = true;
+			return newValue;
+		}
+		if (slot.vertex == vertex && slot.normal == normal && slot.texcoord == texcoord) {
+			added = false;
+			return slot.value;
+		}
+		s = (s + 1) & mask;
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef INDEX_MAP_H
+#define INDEX_MAP_H
+
+#include "main.h"
+
+#include <vector>
+
+/**
+ * @brief Open addressing hash map from an obj (vertex, normal, texcoord)
+ * index triple to the index of the Mesh vertex made from it. Used to give
+ * every shape its own compact, deduplicated vertex array.
+ */
+struct IndexMapSlot
+{
+	int32 vertex;
+	int32 normal;
+	int32 texcoord;
+	uint32 value;
+};
+
+struct IndexMap
+{
+	std::vector<IndexMapSlot> slots;
+	uint32 count;
+};
+
+/**
+ * @brief Empties the map and sizes it for about expectedCount keys, the
+ * allocation is kept when it is already big enough so a map can be reused
+ * from one shape to the next without reallocating.
+ */
+void resetIndexMap(IndexMap& map, size_t expectedCount);
+
+/**
+ * @brief Returns the value stored for the triple, or stores and returns
+ * newValue when the triple hasn't been seen yet, in which case added is set.
+ */
+uint32 findOrAddIndex(IndexMap& map, int32 vertex, int32 normal, int32 texcoord, uint32 newValue, bool& added);
+
+#endif // INDEX_MAP_H
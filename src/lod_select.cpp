@@ -0,0 +1,102 @@
+#include "lod_select.h"
+
+#include "glm/common.hpp"
+#include "glm/geometric.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <functional>
+#include <queue>
+
+static uint32 lodTriangleCount(const Mesh& mesh, uint32 level)
+{
+	return (level ? mesh.lods[level - 1].indexCount : mesh.indexCount()) / 3;
+}
+
+float32 projectedLodError(const Mesh& mesh, uint32 level, const glm::mat4& modelView,
+	const glm::mat4& projection, float32 viewportHeight)
+{
+	if (level == 0) {
+		return 0.0f;
+	}
+	// the model matrix may scale, errors and radius grow with its largest axis
+	float32 scale = std::max(glm::length(glm::vec3(modelView[0])),
+		std::max(glm::length(glm::vec3(modelView[1])), glm::length(glm::vec3(modelView[2]))));
+	glm::vec4 center = modelView * glm::vec4(mesh.bounds.center, 1.0f);
+	// from inside the sphere the error could be right in front of the camera
+	float32 distance = std::max(-center.z - mesh.bounds.radius * scale, 1e-4f);
+	float32 error = mesh.lods[level - 1].error * scale;
+	return error / distance * projection[1][1] * viewportHeight * 0.5f;
+}
+
+void selectLods(std::vector<Mesh>& meshes, const std::vector<bool>& visible, const glm::mat4& modelView,
+	const glm::mat4& projection, float32 viewportHeight, const LodSettings& settings, LodStats& stats)
+{
+	stats = LodStats();
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		Mesh& mesh = meshes[i];
+		uint32 levels = (uint32)mesh.lods.size();
+		uint32 level = std::min(mesh.lodLevel, levels);
+		if (!settings.enabled) {
+			level = 0;
+		}
+		else {
+			// refine as soon as the error shows, only coarsen once it's
+			// comfortably below the limit
+			while (level > 0 && projectedLodError(mesh, level, modelView, projection, viewportHeight) > settings.pixelError) {
+				level--;
+			}
+			float32 coarsenError = settings.pixelError * (1.0f - settings.hysteresis);
+			while (level < levels && projectedLodError(mesh, level + 1, modelView, projection, viewportHeight) <= coarsenError) {
+				level++;
+			}
+		}
+		mesh.lodLevel = level;
+		if (visible[i]) {
+			stats.triangles += lodTriangleCount(mesh, level);
+			stats.fullTriangles += lodTriangleCount(mesh, 0);
+		}
+	}
+	if (!settings.enabled || !settings.useBudget || stats.triangles <= settings.triangleBudget) {
+		return;
+	}
+
+	// over budget, keep taking the next lod of whichever mesh it shows the
+	// least on
+	typedef std::pair<float32, uint32> LodStep;
+	std::priority_queue<LodStep, std::vector<LodStep>, std::greater<LodStep> > steps;
+	for (uint32 i = 0; i < (uint32)meshes.size(); ++i) {
+		const Mesh& mesh = meshes[i];
+		if (visible[i] && mesh.lodLevel < mesh.lods.size()) {
+			steps.push(LodStep(projectedLodError(mesh, mesh.lodLevel + 1, modelView, projection, viewportHeight), i));
+		}
+	}
+	std::vector<bool> overBudget(meshes.size(), false);
+	while (stats.triangles > settings.triangleBudget && !steps.empty()) {
+		uint32 i = steps.top().second;
+		steps.pop();
+		Mesh& mesh = meshes[i];
+		if (!overBudget[i]) {
+			overBudget[i] = true;
+			stats.meshesOverBudget++;
+		}
+		stats.triangles -= lodTriangleCount(mesh, mesh.lodLevel) - lodTriangleCount(mesh, mesh.lodLevel + 1);
+		mesh.lodLevel++;
+		if (mesh.lodLevel < mesh.lods.size()) {
+			steps.push(LodStep(projectedLodError(mesh, mesh.lodLevel + 1, modelView, projection, viewportHeight), i));
+		}
+	}
+}
+
+void lodIndexRange(const Mesh& mesh, uint32& firstIndex, uint32& indexCount)
+{
+	uint32 level = std::min(mesh.lodLevel, (uint32)mesh.lods.size());
+	if (level == 0) {
+		firstIndex = 0;
+		indexCount = mesh.indexCount();
+		return;
+	}
+	firstIndex = mesh.indexCount() + mesh.lods[level - 1].firstIndex;
+	indexCount = mesh.lods[level - 1].indexCount;
+}
@@ -0,0 +1,54 @@
+#ifndef LOD_SELECT_H
+#define LOD_SELECT_H
+
+#include "main.h"
+
+#include "glm/mat4x4.hpp"
+
+#include <vector>
+
+struct LodSettings
+{
+	bool enabled;
+	// largest error a lod may show on screen, in pixels
+	float32 pixelError;
+	// a mesh only switches to a coarser lod once its error is this
+	// fraction below pixelError, so it doesn't pop back and forth
+	float32 hysteresis;
+	// keep the frame under triangleBudget triangles by coarsening the
+	// meshes whose next lod is least visible first
+	bool useBudget;
+	uint32 triangleBudget;
+};
+
+struct LodStats
+{
+	uint32 triangles;
+	uint32 fullTriangles;
+	// meshes drawn at a coarser lod than the pixel error alone asks for
+	uint32 meshesOverBudget;
+};
+
+/**
+ * @brief Error of a mesh lod projected to pixels, for a viewport
+ * viewportHeight pixels high, from the point of mesh.bounds' sphere closest
+ * to the camera.
+ */
+float32 projectedLodError(const Mesh& mesh, uint32 level, const glm::mat4& modelView,
+	const glm::mat4& projection, float32 viewportHeight);
+
+/**
+ * @brief Sets lodLevel of every mesh for the next frame. Only the meshes
+ * marked in visible are drawn, so only they count towards the stats and
+ * the triangle budget.
+ */
+void selectLods(std::vector<Mesh>& meshes, const std::vector<bool>& visible, const glm::mat4& modelView,
+	const glm::mat4& projection, float32 viewportHeight, const LodSettings& settings, LodStats& stats);
+
+/**
+ * @brief Index range of the current lod in the element buffer uploadMesh
+ * creates, which has triangles followed by lodTriangles.
+ */
+void lodIndexRange(const Mesh& mesh, uint32& firstIndex, uint32& indexCount);
+
+#endif // LOD_SELECT_H
@@ -2,20 +2,45 @@
 #include "sdl.h"
 #include "GL/glew.h"
 #include "glm/common.hpp"
+#include "glm/matrix.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtx/rotate_vector.hpp"
 #include "imgui_impl_sdl_gl3.h"
 #include "imgui.h"
 #include "tiny_obj_loader.h"
-
-#include "assimp/cimport.h"
+#include "obj_parser.h"
+#include "mesh_cache.h"
+#include "index_map.h"
+#include "mapped_file.h"
+#include "memory_stats.h"
+#include "mesh_normals.h"
+#include "mesh_weld.h"
+#include "mesh_bounds.h"
+#include "mesh_pipeline.h"
+#include "parallel.h"
+#include "lod_select.h"
+#include "meshlet.h"
+#include "index_buffer.h"
+
+#include "mapped_io.h"
+
+#include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
 #include <string>
 #include <iostream>
+#include <fstream>
 #include <vector>
+#include <algorithm>
 #include <memory>
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
@@ -38,273 +63,781 @@ glm::mat4 getViewMatrix(Camera* cam)
 	return glm::lookAt(cam->position, cam->position + cam->front, cam->up);
 }
 
-void readToEndOfLine(FILE* file)
+/**
+ * @brief Moves the camera along its view direction so the bounding sphere
+ * of all meshes just fits the view.
+ * @return the distance from the camera to the sphere's center, 0 when
+ * there is nothing to frame
+ */
+float32 frameMeshes(Camera* cam, const std::vector<Mesh>& meshes, const glm::mat4& model, const glm::mat4& projection)
 {
-	char buffer[256];
-	fgets(buffer, 256, file);
+	MeshBounds bounds = {};
+	bool any = false;
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		if (!meshes[i].verts.empty()) {
+			bounds = any ? mergeBounds(bounds, meshes[i].bounds) : meshes[i].bounds;
+			any = true;
+		}
+	}
+	if (!any) {
+		return 0.0f;
+	}
+	float32 scale = std::max(glm::length(glm::vec3(model[0])),
+		std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+	glm::vec3 center = glm::vec3(model * glm::vec4(bounds.center, 1.0f));
+	// the sphere touches the narrower side of the view at radius / sin(fov / 2)
+	float32 cotangent = std::min(projection[0][0], projection[1][1]);
+	float32 distance = std::max(bounds.radius * scale, 1e-6f) * std::sqrt(1.0f + cotangent * cotangent);
+	cam->position = center - cam->front * distance;
+	return distance;
 }
 
-void computeNormals(std::vector<Vertex>& verts, std::vector<uint32>& triangles)
+/**
+ * Assimp post-processing profiles. Each maps to an explicit set of steps so
+ * it's obvious what a load pays for, the cheaper ones skip the steps that
+ * only matter for drawing speed or for data the viewer doesn't use.
+ */
+enum AssimpProfile
 {
-	size_t triCount = triangles.size() / 3;
+	AssimpProfileFast,
+	AssimpProfileBalanced,
+	AssimpProfileMaxQuality,
+	AssimpProfileCount
+};
+
+struct AssimpProfileInfo
+{
+	const char* name;
+	uint32 flags;
+};
 
-	// compute the face normals using the cross product of two verts
-	std::vector<glm::vec3> faceNormals(triCount);
-	for (size_t i = 0; i < triCount; ++i) {
-		uint32 v1 = triangles[i * 3 + 0];
-		uint32 v2 = triangles[i * 3 + 1];
-		uint32 v3 = triangles[i * 3 + 2];
-		glm::vec3 v12 = verts[v2].location - verts[v1].location;
-		//glm::vec3 v13 = verts[v3] - verts[v1];
-		glm::vec3 v23 = verts[v3].location - verts[v2].location;
-		faceNormals[i] = glm::cross(v12, v23);
+static const AssimpProfileInfo assimpProfiles[AssimpProfileCount] = {
+	// just enough to draw, every face keeps its own vertices
+	{ "fast",
+		aiProcess_Triangulate
+		| aiProcess_GenNormals
+		| aiProcess_SortByPType },
+	// shared vertices and smooth normals
+	{ "balanced",
+		aiProcess_Triangulate
+		| aiProcess_JoinIdenticalVertices
+		| aiProcess_GenSmoothNormals
+		| aiProcess_SortByPType
+		| aiProcess_FindDegenerates
+		| aiProcess_RemoveRedundantMaterials },
+	// aiProcessPreset_TargetRealtime_MaxQuality without the tangent, uv and
+	// bone steps, nothing we draw uses those
+	{ "max",
+		aiProcess_Triangulate
+		| aiProcess_JoinIdenticalVertices
+		| aiProcess_GenSmoothNormals
+		| aiProcess_SortByPType
+		| aiProcess_FindDegenerates
+		| aiProcess_FindInvalidData
+		| aiProcess_RemoveRedundantMaterials
+		| aiProcess_ImproveCacheLocality
+		| aiProcess_SplitLargeMeshes
+		| aiProcess_FindInstances
+		| aiProcess_ValidateDataStructure
+		| aiProcess_OptimizeMeshes },
+};
+
+/**
+ * Obj loaders to pick from, only assimp has profiles, the others always
+ * load the same way.
+ */
+enum ObjLoader
+{
+	ObjLoaderAssimp,
+	ObjLoaderCustom,
+	ObjLoaderTiny,
+	ObjLoaderTinyStream,
+	ObjLoaderCount
+};
+
+static const char* const objLoaderNames[ObjLoaderCount] = { "assimp", "custom", "tiny", "tinystream" };
+
+/**
+ * Meshes are handed from the loader thread to the render thread one at a
+ * time so the first ones can be drawn while the rest are still loading.
+ * When the requested profile isn't cached yet, a fast preview is loaded
+ * first and the requested quality replaces it as a whole once it's done.
+ */
+struct ObjMeshes
+{
+	std::string objPath;
+	AssimpProfile profile;
+	ObjLoader loader;
+	// run on every mesh by the loader thread before it's published
+	MeshPipeline pipeline;
+	// owned by the render thread, every mesh in here has its gpu buffers
+	std::vector<Mesh> meshes;
+
+	// shared with the loader thread, only touched while holding lock
+	SDL_mutex* lock;
+	std::vector<Mesh> loadedMeshes;
+	uint32 meshesLoaded;
+	uint32 meshesExpected;
+	std::vector<Mesh> upgradedMeshes;
+	bool upgradeReady;
+	bool loadFinished;
+
+	// only used by the loader thread
+	MeshCacheWriter* cacheWriter;
+	uint32 meshesPublished;
+	// meshes are going to upgradedMeshes rather than loadedMeshes
+	bool upgrading;
+	// set by the render thread to stop the loader early
+	SDL_atomic_t cancel;
+};
+
+bool loadCancelled(ObjMeshes* meshes)
+{
+	return SDL_AtomicGet(&meshes->cancel) != 0;
+}
+
+void expectMeshes(ObjMeshes* meshes, uint32 count)
+{
+	// progress is only shown for the first version of the meshes
+	if (meshes->upgrading) {
+		return;
 	}
+	SDL_LockMutex(meshes->lock);
+	meshes->meshesExpected = count;
+	SDL_UnlockMutex(meshes->lock);
+}
 
-	// compute the vert normal using the averages of the face normals
-	// that the vertex is shared by
-	for (size_t iv = 0; iv < verts.size(); ++iv) {
-		glm::vec3 sum(0, 0, 0);
-		uint32 shared = 0;
-		for (size_t it = 0; it < triCount; ++it) {
-			uint32 v1 = triangles[it * 3 + 0];
-			uint32 v2 = triangles[it * 3 + 1];
-			uint32 v3 = triangles[it * 3 + 2];
-			if (iv == v1 || iv == v2 || iv == v3) {
-				sum += faceNormals[it];
-				shared++;
-			}
+void addLoadedMesh(ObjMeshes* meshes, Mesh& mesh, bool countLoaded)
+{
+	addMeshToCache(meshes->cacheWriter, mesh);
+	meshes->meshesPublished++;
+	SDL_LockMutex(meshes->lock);
+	if (meshes->upgrading) {
+		meshes->upgradedMeshes.push_back(std::move(mesh));
+	}
+	else {
+		meshes->loadedMeshes.push_back(std::move(mesh));
+		meshes->meshesLoaded += countLoaded;
+	}
+	SDL_UnlockMutex(meshes->lock);
+}
+
+/**
+ * @brief Publishes a group of meshes and clears it, the pipeline runs on
+ * the whole group in parallel. Loaders that have several meshes at once
+ * collect up to workerCount() of them before publishing so simplifying
+ * big meshes is spread over the cores and meshes still show up in order.
+ */
+void publishMeshGroup(ObjMeshes* meshes, std::vector<Mesh>& group)
+{
+	// progress counts loaded meshes, not the parts they were split into
+	std::vector<bool> firstParts;
+	for (size_t i = 0; i < group.size(); ++i) {
+		if (group[i].cacheView.cached && meshPipelinePending(meshes->pipeline, group[i])) {
+			loadCachedMeshData(group[i]);
+		}
+	}
+	weldMeshes(meshes->pipeline, group.data(), (uint32)group.size());
+	splitMeshes(meshes->pipeline, group, firstParts);
+	runMeshPipeline(meshes->pipeline, group.data(), (uint32)group.size());
+	for (size_t i = 0; i < group.size() && !loadCancelled(meshes); ++i) {
+		addLoadedMesh(meshes, group[i], firstParts[i]);
+	}
+	group.clear();
+}
+
+void publishMesh(ObjMeshes* meshes, Mesh& mesh)
+{
+	std::vector<Mesh> group(1);
+	group[0] = std::move(mesh);
+	publishMeshGroup(meshes, group);
+}
+
+void publishMeshes(ObjMeshes* meshes, std::vector<Mesh>& loaded)
+{
+	expectMeshes(meshes, (uint32)loaded.size());
+	uint32 groupSize = workerCount();
+	std::vector<Mesh> group;
+	for (size_t i = 0; i < loaded.size() && !loadCancelled(meshes); ++i) {
+		group.push_back(std::move(loaded[i]));
+		if (group.size() == groupSize || i + 1 == loaded.size()) {
+			publishMeshGroup(meshes, group);
 		}
-		verts[iv].normal = sum;
-		verts[iv].normal /= (shared * 1.0f);
-		verts[iv].normal = glm::normalize(verts[iv].normal);
 	}
 }
 
-void shareVertices(Mesh& mesh, bool shareVerts)
+/**
+ * @brief Moves the meshes published since the last call into pending, and
+ * the complete set of upgraded meshes into upgraded once they are all in.
+ * @return true once the loader has published its last mesh
+ */
+bool takeLoadedMeshes(ObjMeshes* meshes, std::vector<Mesh>& pending, std::vector<Mesh>& upgraded)
 {
-	bool vertsAreShared = mesh.verts.size() != mesh.triangles.size();
-	if (shareVerts && !vertsAreShared) {
-		logDebug("mesh converted to shared vertices");
+	SDL_LockMutex(meshes->lock);
+	pending.swap(meshes->loadedMeshes);
+	if (meshes->upgradeReady) {
+		upgraded.swap(meshes->upgradedMeshes);
+		meshes->upgradeReady = false;
 	}
-	else if (!shareVerts && vertsAreShared) {
-		std::vector<Vertex> verts(mesh.triangles.size());
-		for (size_t i = 0; i < mesh.triangles.size(); ++i) {
-			verts[i] = mesh.verts[mesh.triangles[i]];
-			mesh.triangles[i] = i;
+	bool finished = meshes->loadFinished;
+	SDL_UnlockMutex(meshes->lock);
+	return finished;
+}
+
+void loadObjCustom(ObjMeshes* meshes)
+{
+	std::vector<Mesh> loaded;
+	loadObj(meshes->objPath, loaded);
+	publishMeshes(meshes, loaded);
+}
+
+void loadObjTiny(ObjMeshes* meshes)
+{
+	tinyobj::attrib_t attrib;
+	std::string err;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+	tinyobj::LoadObj(&attrib, &shapes, &materials, &err, meshes->objPath.c_str());
+	expectMeshes(meshes, (uint32)shapes.size());
+
+	int32 positionCount = (int32)(attrib.vertices.size() / 3);
+	int32 normalCount = (int32)(attrib.normals.size() / 3);
+	int32 texcoordCount = (int32)(attrib.texcoords.size() / 2);
+
+	// each shape only gets the vertices its faces reference, one per distinct
+	// (vertex, normal, texcoord) triple, so a position shared by faces with
+	// different normals is split instead of having its normal overwritten
+	IndexMap indexMap = {};
+	for (size_t is = 0; is < shapes.size() && !loadCancelled(meshes); ++is) {
+		Mesh m = {};
+		m.name = shapes[is].name;
+		const std::vector<tinyobj::index_t>& indices = shapes[is].mesh.indices;
+		resetIndexMap(indexMap, indices.size());
+		m.triangles.reserve(indices.size());
+		for (size_t j = 0; j + 3 <= indices.size(); j += 3) {
+			bool valid = true;
+			for (int k = 0; k < 3; ++k) {
+				int32 vertex = indices[j + k].vertex_index;
+				valid = valid && vertex >= 0 && vertex < positionCount;
+			}
+			if (!valid) {
+				continue;
+			}
+			uint32 tri[3];
+			for (int k = 0; k < 3; ++k) {
+				const tinyobj::index_t& index = indices[j + k];
+				// out of range normals are dropped rather than read past the end
+				int32 normal = index.normal_index < normalCount ? index.normal_index : -1;
+				int32 texcoord = index.texcoord_index < texcoordCount ? index.texcoord_index : -1;
+				bool added = false;
+				tri[k] = findOrAddIndex(indexMap, index.vertex_index, normal, texcoord, (uint32)m.verts.size(), added);
+				if (added) {
+					const float* p = &attrib.vertices[index.vertex_index * 3];
+					Vertex v = { glm::vec3(p[0], p[1], p[2]) };
+					if (normal >= 0) {
+						const float* n = &attrib.normals[normal * 3];
+						v.normal = glm::vec3(n[0], n[1], n[2]);
+					}
+					if (texcoord >= 0) {
+						const float* t = &attrib.texcoords[texcoord * 2];
+						v.texCoord = glm::vec2(t[0], t[1]);
+					}
+					m.verts.push_back(v);
+				}
+			}
+			m.triangles.insert(m.triangles.end(), tri, tri + 3);
 		}
-		mesh.verts = std::move(verts);
-		logDebug("mesh converted to unshared vertices");
+		logDebug("created mesh %s with %d vertices and %d triangles", m.name.c_str(), m.verts.size(), m.triangles.size() / 3);
+		publishMesh(meshes, m);
 	}
 }
 
-void loadMesh(Mesh& mesh, std::vector<Vertex>& verts, std::vector<uint32>& triangles)
+/**
+ * State for loadObjTinyStream, the tinyobj callbacks build meshes straight
+ * from this instead of going through attrib_t and shape_t.
+ */
+struct TinyObjStream
+{
+	ObjMeshes* meshes;
+	// every position, normal and texcoord seen so far, faces may reference
+	// any of them
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> texcoords;
+	// the mesh being built, published when the next group or object starts
+	Mesh mesh;
+	IndexMap indexMap;
+	std::vector<uint32> face;
+	// pre-scanned counts of each shape, used to reserve its buffers
+	std::vector<ObjCounts> groups;
+	size_t group;
+	bool groupHasFaces;
+	uint32 reallocations;
+};
+
+// obj indices are 1 based, negative ones are relative to the end and 0 means
+// the index was left out
+static inline int32 resolveObjIndex(int32 index, int32 count)
+{
+	int32 resolved = index > 0 ? index - 1 : count + index;
+	return index != 0 && resolved >= 0 && resolved < count ? resolved : -1;
+}
+
+static void reserveTinyObjMesh(TinyObjStream* stream)
 {
-	mesh.verts = std::move(verts);
-	mesh.triangles = std::move(triangles);
+	if (stream->group < stream->groups.size()) {
+		const ObjCounts& counts = stream->groups[stream->group];
+		// exact unless a position is split by different normals or texcoords,
+		// or the shape's faces use positions defined in an earlier shape
+		stream->mesh.verts.reserve(counts.positions);
+		stream->mesh.triangles.reserve((size_t)counts.triangles * 3);
+		resetIndexMap(stream->indexMap, counts.positions);
+	}
+	else {
+		resetIndexMap(stream->indexMap, 0);
+	}
 }
 
-void loadObj(std::string objPath, std::vector<Mesh>& meshes) {
-	FILE* file = fopen(objPath.c_str(), "r");
-	if (!file) { return; }
+static void publishTinyObjMesh(TinyObjStream* stream, const char* nextName)
+{
+	// the pre-scan splits shapes on the same rule, so group stays in step
+	if (stream->groupHasFaces) {
+		if (!stream->mesh.triangles.empty()) {
+			logDebug("created mesh %s with %d vertices and %d triangles", stream->mesh.name.c_str(), stream->mesh.verts.size(), stream->mesh.triangles.size() / 3);
+			publishMesh(stream->meshes, stream->mesh);
+		}
+		stream->mesh = Mesh();
+		stream->group++;
+		stream->groupHasFaces = false;
+		reserveTinyObjMesh(stream);
+	}
+	if (nextName) {
+		stream->mesh.name = nextName;
+	}
+}
 
-	std::vector<Vertex> verts;
-	std::vector<uint32> triangles;
+static void tinyObjVertex(void* data, float x, float y, float z, float /*w*/)
+{
+	TinyObjStream* stream = (TinyObjStream*)data;
+	pushCounted(stream->positions, glm::vec3(x, y, z), stream->reallocations);
+}
 
-	uint32 normalCount = 0;
+static void tinyObjNormal(void* data, float x, float y, float z)
+{
+	TinyObjStream* stream = (TinyObjStream*)data;
+	pushCounted(stream->normals, glm::vec3(x, y, z), stream->reallocations);
+}
 
-	bool lastLineWasFace = false;
-	bool hasUV = false;
-	bool hasNorm = false;
-	while (!feof(file))
-	{
-		float x, y, z;
-		float nx, ny, nz;
-		char ch = fgetc(file);
+static void tinyObjTexcoord(void* data, float x, float y, float /*z*/)
+{
+	TinyObjStream* stream = (TinyObjStream*)data;
+	pushCounted(stream->texcoords, glm::vec2(x, y), stream->reallocations);
+}
 
-		switch (ch)
-		{
-		case 'v':
-		{
-			if (lastLineWasFace) {
-				Mesh mesh;
-				loadMesh(mesh, verts, triangles);
-				meshes.push_back(std::move(mesh));
-				verts.clear();
-				triangles.clear();
-				lastLineWasFace = false;
-				hasUV = false;
-			}
-
-			char ch = fgetc(file);
-			char buffer[256];
-			fgets(&buffer[0], 256, file);
-
-			if (ch == ' ') {
-				sscanf(&buffer[0], "%f %f %f", &x, &y, &z);
-				verts.push_back(Vertex { glm::vec3(x, y, z) });
-			}
-			else if (ch == 't') {
-				// indicates a texture coord
-				hasUV = true;
-			}
-			else if (ch == 'n') {
-				// indicates a normal
-				hasNorm = true;
-				sscanf(&buffer[0], "%f %f %f", &nx, &ny, &nz);
-				Vertex& vert = verts[normalCount++];
-				vert.normal = glm::vec3(nx, ny, nz);
-			}
-			break;
+static void tinyObjFace(void* data, tinyobj::index_t* indices, int count)
+{
+	TinyObjStream* stream = (TinyObjStream*)data;
+	stream->groupHasFaces = true;
+	if (loadCancelled(stream->meshes)) {
+		return;
+	}
+	Mesh& m = stream->mesh;
+	int32 positionCount = (int32)stream->positions.size();
+	int32 normalCount = (int32)stream->normals.size();
+
+	// faces with a missing position are dropped as a whole
+	for (int i = 0; i < count; ++i) {
+		if (resolveObjIndex(indices[i].vertex_index, positionCount) < 0) {
+			return;
 		}
-		case 'f':
-		{
-			char buffer[256];
-			fgets(&buffer[0], 256, file);
-			int32 v1, v2, v3, v4;
-			v1 = v2 = v3 = v4 = 0;
-			int count = 0;
-			if (hasUV) {
-				int32 vt1, vt2, vt3, vt4;
-				if (hasNorm) {
-					int32 vn1, vn2, vn3, vn4;
-					count = sscanf(&buffer[0], "%d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d", 
-						&v1, &vt1, &vn1,
-						&v2, &vt2, &vn2,
-						&v3, &vt3, &vn3,
-						&v4, &vt4, &vn4);
-				}
-				else {
-					count = sscanf(&buffer[0], "%d/%d %d/%d %d/%d %d/%d", &v1, &vt1, &v2, &vt2, &v3, &vt3, &v4, &vt4);
-				}
+	}
+	if (count < 3) {
+		return;
+	}
+
+	stream->face.clear();
+	for (int i = 0; i < count; ++i) {
+		int32 vertex = resolveObjIndex(indices[i].vertex_index, positionCount);
+		int32 normal = resolveObjIndex(indices[i].normal_index, normalCount);
+		int32 texcoord = resolveObjIndex(indices[i].texcoord_index, (int32)stream->texcoords.size());
+		bool added = false;
+		uint32 index = findOrAddIndex(stream->indexMap, vertex, normal, texcoord, (uint32)m.verts.size(), added);
+		if (added) {
+			Vertex v = { stream->positions[vertex] };
+			if (normal >= 0) {
+				v.normal = stream->normals[normal];
 			}
-			else if (hasNorm) {
-				int32 vn1, vn2, vn3, vn4;
-				count = sscanf(&buffer[0], "%d//%d %d//%d %d//%d %d//%d",
-					&v1, &vn1,
-					&v2, &vn2,
-					&v3, &vn3,
-					&v4, &vn4);
+			if (texcoord >= 0) {
+				v.texCoord = stream->texcoords[texcoord];
 			}
-			else {
-				sscanf(&buffer[0], "%d %d %d %d", &v1, &v2, &v3, &v4);
-			}
-			if (v1 < 0) { v1 = v1 + 1 + verts.size(); }
-			if (v2 < 0) { v2 = v2 + 1 + verts.size(); }
-			if (v3 < 0) { v3 = v3 + 1 + verts.size(); }
-			if (v4 < 0) { v4 = v4 + 1 + verts.size(); }
-			// make indices 0-based
-			triangles.push_back(v1 - 1);
-			triangles.push_back(v2 - 1);
-			triangles.push_back(v3 - 1);
-			if (v4 != 0) {
-				logDebug("quad found");
-				triangles.push_back(v1 - 1);
-				triangles.push_back(v3 - 1);
-				triangles.push_back(v4 - 1);
-			}
-			lastLineWasFace = true;
-			break;
-		}
-		case '\n':
-			break;
-		default:
-			readToEndOfLine(file);
+			pushCounted(m.verts, v, stream->reallocations);
 		}
+		stream->face.push_back(index);
 	}
 
-	Mesh mesh;
-	loadMesh(mesh, verts, triangles);
-	meshes.push_back(std::move(mesh));
+	// triangulate as a fan, like LoadObj does
+	for (size_t i = 2; i < stream->face.size(); ++i) {
+		pushCounted(m.triangles, stream->face[0], stream->reallocations);
+		pushCounted(m.triangles, stream->face[i - 1], stream->reallocations);
+		pushCounted(m.triangles, stream->face[i], stream->reallocations);
+	}
 }
 
-struct ObjMeshes
+static void tinyObjGroup(void* data, const char** names, int count)
 {
-	std::string objPath;
-	std::vector<Mesh> meshes;
-};
+	publishTinyObjMesh((TinyObjStream*)data, count > 0 ? names[0] : "");
+}
 
-void loadObjTiny(ObjMeshes* meshes)
+static void tinyObjObject(void* data, const char* name)
 {
-	tinyobj::attrib_t attrib;
+	publishTinyObjMesh((TinyObjStream*)data, name);
+}
+
+/**
+ * @brief Same meshes as loadObjTiny, but built directly from the tinyobj
+ * callbacks so the file is never held as attrib_t and shape_t arrays on top
+ * of the meshes made from them. Each mesh is published as soon as the next
+ * group or object starts.
+ */
+void loadObjTinyStream(ObjMeshes* meshes)
+{
+	std::ifstream file(meshes->objPath.c_str(), std::ios::in | std::ios::binary);
+	if (!file) {
+		logError("Failed to open obj file %s", meshes->objPath.c_str());
+		return;
+	}
+
+	TinyObjStream stream = {};
+	stream.meshes = meshes;
+
+	// count everything up front so no buffer has to grow while parsing
+	MappedFile mapped;
+	if (mapFile(mapped, meshes->objPath)) {
+		ObjCounts total = {};
+		countObj(mapped.data, mapped.size, total, &stream.groups);
+		unmapFile(mapped);
+		stream.positions.reserve(total.positions);
+		stream.normals.reserve(total.normals);
+		stream.texcoords.reserve(total.texcoords);
+		logDebug("pre-scan found %d positions, %d normals, %d faces (%d quads) in %d shapes",
+			total.positions, total.normals, total.faces, total.quads, (int)stream.groups.size());
+	}
+	reserveTinyObjMesh(&stream);
+
+	tinyobj::callback_t callback;
+	callback.vertex_cb = tinyObjVertex;
+	callback.normal_cb = tinyObjNormal;
+	callback.texcoord_cb = tinyObjTexcoord;
+	callback.index_cb = tinyObjFace;
+	callback.group_cb = tinyObjGroup;
+	callback.object_cb = tinyObjObject;
+
 	std::string err;
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-	tinyobj::LoadObj(&attrib, &shapes, &materials, &err, meshes->objPath.c_str());
-	for (size_t i = 0; i < shapes.size(); ++i) {
-		Mesh m = {};
-		m.name = shapes[i].name;
-		for (size_t i = 0; i < attrib.vertices.size(); i += 3) {
-			m.verts.push_back(
-				Vertex {
-					glm::vec3(
-						attrib.vertices[i],
-						attrib.vertices[i + 1],
-						attrib.vertices[i + 2]),
-				});
-		}
-		tinyobj::mesh_t& mesht = shapes[i].mesh;
-		for (size_t j = 0; j < mesht.indices.size(); j++) {
-			if (mesht.indices[j].normal_index != -1) {
-				Vertex& v = m.verts[mesht.indices[j].vertex_index];
-				v.normal = glm::vec3(
-						attrib.normals[mesht.indices[j].normal_index],
-						attrib.normals[mesht.indices[j].normal_index + 1],
-						attrib.normals[mesht.indices[j].normal_index + 2]);
-			}
-			m.triangles.push_back(mesht.indices[j].vertex_index);
+	if (!tinyobj::LoadObjWithCallback(file, callback, &stream, 0, &err)) {
+		logError("Failed to load obj file: %s", err.c_str());
+	}
+	if (!loadCancelled(meshes)) {
+		publishTinyObjMesh(&stream, 0);
+	}
+	logDebug("streamed %s with %d reallocations", meshes->objPath.c_str(), stream.reallocations);
+}
+
+/**
+ * Interleaves assimp's separate position, normal and texture coordinate
+ * arrays into Vertex. Positions and normals are copied with overlapping 4
+ * float stores, the fourth float of the position store is overwritten by
+ * the normal and the one of the normal store by the texture coordinate.
+ * The loads read a float past each vector, so the last vertex is scalar.
+ */
+void interleaveVertices(const aiVector3D* positions, const aiVector3D* normals, const aiVector3D* texCoords,
+	uint32 count, Vertex* verts)
+{
+	static_assert(sizeof(aiVector3D) == sizeof(glm::vec3), "assimp built with double precision");
+	static_assert(offsetof(Vertex, normal) == 3 * sizeof(float) && offsetof(Vertex, texCoord) == 6 * sizeof(float),
+		"Vertex layout changed");
+	uint32 i = 0;
+	if (!normals) {
+		for (; i < count; ++i) {
+			verts[i].location = glm::vec3(positions[i].x, positions[i].y, positions[i].z);
+			verts[i].normal = glm::vec3(0.0f);
 		}
-		meshes->meshes.push_back(std::move(m));
+	}
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	for (; i + 1 < count; ++i) {
+		float* out = (float*)(verts + i);
+		_mm_storeu_ps(out, _mm_loadu_ps((const float*)(positions + i)));
+		_mm_storeu_ps(out + 3, _mm_loadu_ps((const float*)(normals + i)));
+	}
+#endif
+	for (; i < count; ++i) {
+		verts[i].location = glm::vec3(positions[i].x, positions[i].y, positions[i].z);
+		verts[i].normal = glm::vec3(normals[i].x, normals[i].y, normals[i].z);
+	}
+	for (i = 0; i < count; ++i) {
+		verts[i].texCoord = texCoords ? glm::vec2(texCoords[i].x, texCoords[i].y) : glm::vec2(0.0f);
+		verts[i].tangent = 0;
 	}
 }
 
-void loadObjAssimp(ObjMeshes* meshes)
+void loadObjAssimp(ObjMeshes* meshes, AssimpProfile profile)
 {
-	const aiScene* scene = aiImportFile(meshes->objPath.c_str(), aiProcessPreset_TargetRealtime_MaxQuality);
+	resetPeakMemoryUsage();
+	size_t memoryBefore = currentMemoryUsage();
+
+	const AssimpProfileInfo& info = assimpProfiles[profile];
+	uint32 importStart = SDL_GetTicks();
+	// files are read straight from shared mappings, the importer owns the
+	// io system and deletes it
+	Assimp::Importer importer;
+	importer.SetIOHandler(new MappedIOSystem());
+	const aiScene* scene = importer.ReadFile(meshes->objPath.c_str(), info.flags);
 	if (!scene) {
-		logError("Failed to load obj file");
+		logError("Failed to load obj file: %s", importer.GetErrorString());
 		return;
 	}
-	for (uint32 im = 0; im < scene->mNumMeshes; ++im) {
+	uint32 convertStart = SDL_GetTicks();
+	size_t memoryScene = currentMemoryUsage();
+
+	expectMeshes(meshes, scene->mNumMeshes);
+	uint32 groupSize = workerCount();
+	std::vector<Mesh> group;
+	for (uint32 im = 0; im < scene->mNumMeshes && !loadCancelled(meshes); ++im) {
 		Mesh m = {};
-		aiMesh* aiMesh = scene->mMeshes[im];
-		for (uint32 i = 0; i < aiMesh->mNumVertices; ++i) {
-			m.verts.push_back(
-				Vertex {
-					glm::vec3(
-						aiMesh->mVertices[i].x,
-						aiMesh->mVertices[i].y,
-						aiMesh->mVertices[i].z),
-					glm::vec3(
-						aiMesh->mNormals[i].x,
-						aiMesh->mNormals[i].y,
-						aiMesh->mNormals[i].z)
-				});
-		}
+		const aiMesh* aiMesh = scene->mMeshes[im];
+		m.name = aiMesh->mName.C_Str();
+		m.verts.resize(aiMesh->mNumVertices);
+		interleaveVertices(aiMesh->mVertices, aiMesh->mNormals, aiMesh->mTextureCoords[0], aiMesh->mNumVertices, m.verts.data());
+
+		// points and lines can be mixed in, only triangles are drawn
+		m.triangles.resize(aiMesh->mNumFaces * 3);
+		size_t count = 0;
 		for (uint32 i = 0; i < aiMesh->mNumFaces; ++i) {
 			const aiFace& face = aiMesh->mFaces[i];
-			m.triangles.push_back(face.mIndices[0]);
-			m.triangles.push_back(face.mIndices[1]);
-			m.triangles.push_back(face.mIndices[2]);
+			if (face.mNumIndices == 3) {
+				m.triangles[count++] = face.mIndices[0];
+				m.triangles[count++] = face.mIndices[1];
+				m.triangles[count++] = face.mIndices[2];
+			}
 		}
+		m.triangles.resize(count);
 		logDebug("created mesh with %d vertices and %d triangles", m.verts.size(), m.triangles.size() / 3);
-		meshes->meshes.push_back(std::move(m));
+		group.push_back(std::move(m));
+		if (group.size() == groupSize) {
+			publishMeshGroup(meshes, group);
+		}
+	}
+	if (!loadCancelled(meshes)) {
+		publishMeshGroup(meshes, group);
 	}
+
+	// the meshes are ours now, don't keep assimp's copy around with them
+	importer.FreeScene();
+	trimMemory();
+
+	uint32 end = SDL_GetTicks();
+	logDebug("assimp %s profile: %d ms import, %d ms convert, %d ms total",
+		info.name, convertStart - importStart, end - convertStart, end - importStart);
+
+	const size_t mb = 1024 * 1024;
+	logDebug("assimp import memory: %d MB before, %d MB with scene, %d MB peak, %d MB after release",
+		(int)(memoryBefore / mb), (int)(memoryScene / mb), (int)(peakMemoryUsage() / mb), (int)(currentMemoryUsage() / mb));
+}
+
+/**
+ * Meshes from every loader and assimp profile are cached separately.
+ */
+const char* meshCacheVariant(ObjMeshes* meshes, AssimpProfile profile)
+{
+	return meshes->loader == ObjLoaderAssimp ? assimpProfiles[profile].name : objLoaderNames[meshes->loader];
+}
+
+/**
+ * Imports objPath with the selected loader, and the given profile for
+ * assimp, unless it is already cached, the meshes go into that variant's
+ * cache as they are published.
+ */
+void importObj(ObjMeshes* meshes, AssimpProfile profile, bool useCache)
+{
+	const char* variant = meshCacheVariant(meshes, profile);
+	std::vector<Mesh> cached;
+	if (useCache && readMeshCache(meshes->objPath, cached, variant)) {
+		publishMeshes(meshes, cached);
+		return;
+	}
+	meshes->cacheWriter = beginMeshCache(meshes->objPath, variant);
+	meshes->meshesPublished = 0;
+	switch (meshes->loader) {
+	case ObjLoaderCustom:
+		loadObjCustom(meshes);
+		break;
+	case ObjLoaderTiny:
+		loadObjTiny(meshes);
+		break;
+	case ObjLoaderTinyStream:
+		loadObjTinyStream(meshes);
+		break;
+	default:
+		loadObjAssimp(meshes, profile);
+		break;
+	}
+	bool complete = !loadCancelled(meshes) && meshes->meshesPublished > 0;
+	finishMeshCache(meshes->cacheWriter, complete);
+	meshes->cacheWriter = 0;
 }
 
 int loadObjThread(void* data)
 {
 	ObjMeshes* meshes = (ObjMeshes*) data;
-	//loadObj(meshes->objPath, meshes->meshes);
-	loadObjAssimp(meshes);
+	AssimpProfile profile = meshes->profile;
+	std::vector<Mesh> cached;
+	if (readMeshCache(meshes->objPath, cached, meshCacheVariant(meshes, profile))) {
+		publishMeshes(meshes, cached);
+	}
+	else if (meshes->loader != ObjLoaderAssimp || profile == AssimpProfileFast) {
+		importObj(meshes, profile, false);
+	}
+	else {
+		// something to look at quickly, then the real thing in the background
+		importObj(meshes, AssimpProfileFast, true);
+		meshes->upgrading = true;
+		importObj(meshes, profile, false);
+		if (!loadCancelled(meshes) && meshes->meshesPublished > 0) {
+			SDL_LockMutex(meshes->lock);
+			meshes->upgradeReady = true;
+			SDL_UnlockMutex(meshes->lock);
+		}
+	}
+	SDL_LockMutex(meshes->lock);
+	meshes->loadFinished = true;
+	SDL_UnlockMutex(meshes->lock);
 	return 0;
 }
 
 SDL_Thread* loadObjAsync(ObjMeshes& objMeshes)
 {
+	objMeshes.lock = SDL_CreateMutex();
 	SDL_Thread* thread = SDL_CreateThread(loadObjThread, "loadObjThead", &objMeshes);
 	return thread;
 }
 
+/**
+ * @brief Points attribs 0 to 3 (position, normal, tangent, texture coord)
+ * at the mesh's vbo, which holds either Vertex or QuantizedVertex followed
+ * by QuantizedTangentSpace. Quantized meshes without the latter get a
+ * constant tangent and texture coord instead.
+ */
+void bindVertexAttribs(const Mesh* mesh)
+{
+	if (mesh->quantized()) {
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(QuantizedVertex), 0);
+		glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(QuantizedVertex), (GLvoid*)offsetof(QuantizedVertex, normal));
+		if (!mesh->hasQuantizedTangentSpace()) {
+			glDisableVertexAttribArray(2);
+			glDisableVertexAttribArray(3);
+			glVertexAttrib4f(2, 1.0f, 0.0f, 0.0f, 1.0f);
+			glVertexAttrib2f(3, 0.0f, 0.0f);
+			return;
+		}
+		size_t tangentSpace = mesh->vertexCount() * sizeof(QuantizedVertex);
+		glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(QuantizedTangentSpace),
+			(GLvoid*)(tangentSpace + offsetof(QuantizedTangentSpace, tangent)));
+		glVertexAttribPointer(3, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(QuantizedTangentSpace),
+			(GLvoid*)(tangentSpace + offsetof(QuantizedTangentSpace, texCoord)));
+	}
+	else {
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, normal));
+		glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, tangent));
+		glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, texCoord));
+	}
+	glEnableVertexAttribArray(2);
+	glEnableVertexAttribArray(3);
+}
+
+void uploadMesh(Mesh* mesh, GLuint vao)
+{
+	//computeNormals(mesh->verts, mesh->triangles);
+	if (mesh->empty() || mesh->indexCount() == 0) {
+		return;
+	}
+	glGenBuffers(1, &mesh->vbo);
+	glGenBuffers(1, &mesh->ebo);
+
+	glBindVertexArray(vao);
+
+	// one vbo contains all vertex attributes, see bindVertexAttribs
+	glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+	MeshCacheView& cached = mesh->cacheView;
+	if (cached.mapping) {
+		// already laid out as uploaded, straight from the cache mapping
+		glBufferData(GL_ARRAY_BUFFER, cached.vertexBufferSize, cached.vertexBuffer, GL_STATIC_DRAW);
+	}
+	else if (!mesh->quantizedVerts.empty()) {
+		size_t vertsSize = mesh->quantizedVerts.size() * sizeof(QuantizedVertex);
+		size_t tangentSpaceSize = mesh->quantizedTangentSpace.size() * sizeof(QuantizedTangentSpace);
+		glBufferData(GL_ARRAY_BUFFER, vertsSize + tangentSpaceSize, 0, GL_STATIC_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, vertsSize, &mesh->quantizedVerts[0]);
+		if (tangentSpaceSize) {
+			glBufferSubData(GL_ARRAY_BUFFER, vertsSize, tangentSpaceSize, &mesh->quantizedTangentSpace[0]);
+		}
+	}
+	else {
+		glBufferData(GL_ARRAY_BUFFER, mesh->verts.size() * sizeof(Vertex), &mesh->verts[0], GL_STATIC_DRAW);
+	}
+	// 2 and 3 depend on the mesh, bindVertexAttribs enables those
+	bindVertexAttribs(mesh);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+
+	// bind the triangle indices, the lods follow the full mesh in the same
+	// buffer so switching lod is just a different range
+	size_t triangleCount = mesh->triangles.size();
+	size_t lodCount = mesh->lodTriangles.size();
+	mesh->indexSize = meshIndexSize(*mesh);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ebo);
+	if (cached.mapping) {
+		// packed to indexSize when it was cached
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, cached.indexBufferSize, cached.indexBuffer, GL_STATIC_DRAW);
+		// the counts stay, the mapping can go once every mesh is uploaded
+		cached.mapping.reset();
+		cached.entry = 0;
+		cached.vertexBuffer = 0;
+		cached.indexBuffer = 0;
+	}
+	else if (mesh->indexSize == sizeof(uint16_t)) {
+		// halves the index memory and bandwidth of every mesh that fits
+		std::vector<uint16_t> packed(triangleCount + lodCount);
+		packIndices16(&mesh->triangles[0], (uint32)triangleCount, &packed[0]);
+		if (lodCount) {
+			packIndices16(&mesh->lodTriangles[0], (uint32)lodCount, &packed[triangleCount]);
+		}
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, packed.size() * sizeof(uint16_t), &packed[0], GL_STATIC_DRAW);
+	}
+	else {
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, (triangleCount + lodCount) * sizeof(uint32), 0, GL_STATIC_DRAW);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, triangleCount * sizeof(uint32), &mesh->triangles[0]);
+		if (lodCount) {
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, triangleCount * sizeof(uint32), lodCount * sizeof(uint32), &mesh->lodTriangles[0]);
+		}
+	}
+
+	glBindVertexArray(0);
+
+	mesh->lodLevel = 0;
+}
+
+void deleteMeshBuffers(Mesh* mesh)
+{
+	if (mesh->vbo) {
+		glDeleteBuffers(1, &mesh->vbo);
+		mesh->vbo = 0;
+	}
+	if (mesh->ebo) {
+		glDeleteBuffers(1, &mesh->ebo);
+		mesh->ebo = 0;
+	}
+}
+
 void checkSDLError(int line = -1)
 {
 	std::string error = SDL_GetError();
@@ -321,7 +854,12 @@ void checkSDLError(int line = -1)
 	}
 }
 
-GLuint loadShader(std::string shaderPath, GLenum shaderType)
+/**
+ * @brief Compiles a shader, defines (e.g. "#define FLAT_SHADING 1\n") are
+ * inserted after the #version line so one file can give several
+ * permutations.
+ */
+GLuint loadShader(std::string shaderPath, GLenum shaderType, const std::string& defines)
 {
 	SDL_RWops* file = SDL_RWFromFile(shaderPath.c_str(), "r");
 	if (!file) {
@@ -336,8 +874,13 @@ GLuint loadShader(std::string shaderPath, GLenum shaderType)
 	SDL_RWread(file, contents, size, 1);
 	SDL_RWclose(file);
 
+	// #version has to stay the first line
+	const char* body = strchr(contents, '\n');
+	body = body ? body + 1 : contents + size;
+	const char* sources[3] = { contents, defines.c_str(), body };
+	GLint lengths[3] = { (GLint)(body - contents), (GLint)defines.size(), -1 };
 	GLuint shaderId = glCreateShader(shaderType);
-	glShaderSource(shaderId, 1, (const char**)&contents, 0);
+	glShaderSource(shaderId, 3, sources, lengths);
 	glCompileShader(shaderId);
 	free(contents);
 
@@ -354,10 +897,10 @@ GLuint loadShader(std::string shaderPath, GLenum shaderType)
 	return shaderId;
 }
 
-GLuint loadShaders(std::string vertShaderPath, std::string fragShaderPath)
+GLuint loadShaders(std::string vertShaderPath, std::string fragShaderPath, const std::string& defines = std::string())
 {
-	GLuint vertShaderId = loadShader(vertShaderPath, GL_VERTEX_SHADER);
-	GLuint fragShaderId = loadShader(fragShaderPath, GL_FRAGMENT_SHADER);
+	GLuint vertShaderId = loadShader(vertShaderPath, GL_VERTEX_SHADER, defines);
+	GLuint fragShaderId = loadShader(fragShaderPath, GL_FRAGMENT_SHADER, defines);
 	if (vertShaderId != -1 && fragShaderId != -1) {
 		GLuint programId = glCreateProgram();
 		glAttachShader(programId, vertShaderId);
@@ -376,8 +919,45 @@ GLuint loadShaders(std::string vertShaderPath, std::string fragShaderPath)
 	return -1;
 }
 
+/**
+ * The phong program and its uniforms, which are located per permutation.
+ */
+struct PhongProgram
+{
+	GLuint id;
+	GLint m;
+	GLint mvp;
+	GLint lightPos;
+	GLint lightColor;
+	GLint objectColor;
+	GLint quantized;
+	GLint positionOffset;
+	GLint positionScale;
+};
+
+PhongProgram loadPhongProgram(const std::string& defines)
+{
+	PhongProgram program;
+	program.id = loadShaders("phongvertshader.vert", "phongfragshader.frag", defines);
+	program.m = glGetUniformLocation(program.id, "u_M");
+	program.mvp = glGetUniformLocation(program.id, "u_MVP");
+	program.lightPos = glGetUniformLocation(program.id, "u_lightPos");
+	program.lightColor = glGetUniformLocation(program.id, "u_lightColor");
+	program.objectColor = glGetUniformLocation(program.id, "u_objectColor");
+	program.quantized = glGetUniformLocation(program.id, "u_quantized");
+	program.positionOffset = glGetUniformLocation(program.id, "u_positionOffset");
+	program.positionScale = glGetUniformLocation(program.id, "u_positionScale");
+	return program;
+}
+
 int main(int argc, char *argv[])
 {
+	if (argc > 1 && std::string(argv[1]) == "--bench-normals") {
+		SDL_LogSetAllPriority(SDL_LOG_PRIORITY_DEBUG);
+		benchmarkNormals(argc > 2 ? (uint32)stoul(argv[2]) : 10000000);
+		return 0;
+	}
+
 	if(SDL_Init(SDL_INIT_VIDEO) < 0) {
 		std::cout << "Failed to init SDL" << std::endl;
 		return 1;
@@ -425,7 +1005,12 @@ int main(int argc, char *argv[])
 	// Accept fragment if it closer to the camera than the former one
 	glDepthFunc(GL_LESS);
 
-	GLuint programId = loadShaders("phongvertshader.vert", "phongfragshader.frag");
+	// flat shading is a permutation that takes face normals from screen
+	// space derivatives, switching it only switches programs
+	PhongProgram phongPrograms[2] = {
+		loadPhongProgram(std::string()),
+		loadPhongProgram("#define FLAT_SHADING 1\n")
+	};
 
 	std::string filePath;
 	if (argc > 1) {
@@ -434,51 +1019,73 @@ int main(int argc, char *argv[])
 	}
 
 	float32 scaleFactor = 1.0f;
+	// without a scale the camera frames the model once it's loaded
+	bool frameOnLoad = true;
 	if (argc > 2) {
 		// assume third arg is the scale factor
 		scaleFactor = stof(argv[2]);
+		frameOnLoad = false;
+	}
+
+	AssimpProfile importProfile = AssimpProfileMaxQuality;
+	if (argc > 3) {
+		// assume fourth arg is the import profile
+		importProfile = AssimpProfileCount;
+		for (int i = 0; i < AssimpProfileCount; ++i) {
+			if (assimpProfiles[i].name == std::string(argv[3])) {
+				importProfile = (AssimpProfile)i;
+			}
+		}
+		if (importProfile == AssimpProfileCount) {
+			logError("Unknown import profile %s, expected fast, balanced or max, using max", argv[3]);
+			importProfile = AssimpProfileMaxQuality;
+		}
+	}
+
+	ObjLoader loader = ObjLoaderAssimp;
+	if (argc > 4) {
+		// and the fifth the loader, the profile only matters for assimp
+		loader = ObjLoaderCount;
+		for (int i = 0; i < ObjLoaderCount; ++i) {
+			if (objLoaderNames[i] == std::string(argv[4])) {
+				loader = (ObjLoader)i;
+			}
+		}
+		if (loader == ObjLoaderCount) {
+			logError("Unknown loader %s, expected assimp, custom, tiny or tinystream, using assimp", argv[4]);
+			loader = ObjLoaderAssimp;
+		}
 	}
 
 	bool flatShading = false;
 
-	ObjMeshes objMeshes = { filePath };
+	ObjMeshes objMeshes = { filePath, importProfile, loader };
+	// only exact duplicates, so seams and hard edges stay as modelled
+	objMeshes.pipeline.weldVertices = true;
+	objMeshes.pipeline.weldEpsilon = 0.0f;
+	objMeshes.pipeline.weldNormalAngle = 1.0f;
+	objMeshes.pipeline.optimizeVertexCache = true;
+	objMeshes.pipeline.optimizeOverdraw = true;
+	objMeshes.pipeline.overdrawThreshold = 1.05f;
+	objMeshes.pipeline.optimizeVertexFetch = true;
+	const float lodRatios[] = { 0.5f, 0.25f, 0.125f, 0.0625f };
+	objMeshes.pipeline.lodRatios.assign(lodRatios, lodRatios + 4);
+	objMeshes.pipeline.lodMinTriangles = 1024;
+	objMeshes.pipeline.buildMeshlets = true;
+	objMeshes.pipeline.generateTangents = true;
+	objMeshes.pipeline.quantizeVertices = true;
+	objMeshes.pipeline.splitMaxVertices = 4 * maxIndex16Vertices;
+	SDL_Thread* loadThread = 0;
+	uint32 loadStart = SDL_GetTicks();
 	if (!filePath.empty()) {
 		logDebug("loading %s", filePath.c_str());
-		uint32 start = SDL_GetTicks();
-		SDL_Thread* loadThread = loadObjAsync(objMeshes);
-		SDL_WaitThread(loadThread, 0);
-		logDebug("loaded in %d ms", SDL_GetTicks() - start);
+		loadThread = loadObjAsync(objMeshes);
 	}
 
 	GLuint vao = 0;
 	glGenVertexArrays(1, &vao);
-	for (int i = 0; i < objMeshes.meshes.size(); ++i) {
-		Mesh* mesh = &objMeshes.meshes[i];
-		//shareVertices(*mesh, true);
-		//computeNormals(mesh->verts, mesh->triangles);
-		glGenBuffers(1, &mesh->vbo);
-		glGenBuffers(1, &mesh->ebo);
-
-		glBindVertexArray(vao);
-
-		// one vbo contains both vert locations and normals
-		glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
-		glBufferData(GL_ARRAY_BUFFER, mesh->verts.size() * sizeof(Vertex), &mesh->verts[0], GL_STATIC_DRAW);
-
-		// positions bound to attrib 0
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
-		glEnableVertexAttribArray(0);
-
-		// normals bound to attrib 1
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)sizeof(glm::vec3));
-		glEnableVertexAttribArray(1);
-
-		// bind the triangle indices
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ebo);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->triangles.size() * sizeof(uint32), &mesh->triangles[0], GL_STATIC_DRAW);
-
-		glBindVertexArray(0);
-	}
+	std::vector<Mesh> pendingMeshes;
+	std::vector<Mesh> upgradedMeshes;
 
 	Camera camera = {};
 	camera.position = glm::vec3(0, 0, 20);
@@ -498,6 +1105,27 @@ int main(int argc, char *argv[])
 	// 0 = z-forward, 1 = y-forward
 	int32 forwardVector = 0;
 
+	LodSettings lodSettings = {};
+	lodSettings.enabled = true;
+	lodSettings.pixelError = 1.0f;
+	lodSettings.hysteresis = 0.25f;
+	lodSettings.useBudget = false;
+	lodSettings.triangleBudget = 1000000;
+	LodStats lodStats = {};
+
+	// back faces aren't culled by gl, so cone culling is only right for
+	// closed meshes and is off by default
+	bool frameRequested = false;
+	bool meshletCulling = true;
+	bool meshletConeCulling = false;
+	uint32 meshletsVisible = 0;
+	uint32 meshletsTotal = 0;
+	uint32 meshesVisible = 0;
+	std::vector<bool> meshVisible;
+	std::vector<IndexRange> meshletRanges;
+	std::vector<GLsizei> drawCounts;
+	std::vector<const GLvoid*> drawOffsets;
+
 	glm::mat4 projection = glm::perspective(glm::degrees(camera.zoom), aspect, nearClip, farClip);
 	glm::mat4 view = getViewMatrix(&camera);
 	glm::mat4 modelScale = glm::scale(glm::mat4(1.0f), glm::vec3(scaleFactor));
@@ -506,14 +1134,6 @@ int main(int argc, char *argv[])
 	glm::mat4 mv = view * model;
 	glm::mat4 mvp = projection * mv;
 
-	GLuint mId = glGetUniformLocation(programId, "u_M");
-	//GLuint vId = glGetUniformLocation(programId, "V");
-	//GLuint mvId = glGetUniformLocation(programId, "MV");
-	GLuint mvpId = glGetUniformLocation(programId, "u_MVP");
-	GLuint lightPosId = glGetUniformLocation(programId, "u_lightPos");
-	GLuint lightColorId = glGetUniformLocation(programId, "u_lightColor");
-	GLuint objectColorId = glGetUniformLocation(programId, "u_objectColor");
-
 	//glm::vec3 lightPos(0.0, 2.0, 0.0);
 	glm::vec3 lightPos(camera.position);
 	glm::vec3 lightColor(1.0, 1.0, 1.0);
@@ -598,6 +1218,40 @@ int main(int argc, char *argv[])
 			}
 		}
 
+		// upload whatever the loader finished since the last frame
+		if (loadThread) {
+			bool loadFinished = takeLoadedMeshes(&objMeshes, pendingMeshes, upgradedMeshes);
+			for (size_t i = 0; i < pendingMeshes.size(); ++i) {
+				if (objMeshes.meshes.empty()) {
+					logDebug("first mesh after %d ms", SDL_GetTicks() - loadStart);
+				}
+				uploadMesh(&pendingMeshes[i], vao);
+				objMeshes.meshes.push_back(std::move(pendingMeshes[i]));
+			}
+			pendingMeshes.clear();
+			if (!upgradedMeshes.empty()) {
+				// swap the preview out for the full quality meshes in one go
+				for (size_t i = 0; i < upgradedMeshes.size(); ++i) {
+					uploadMesh(&upgradedMeshes[i], vao);
+				}
+				for (size_t i = 0; i < objMeshes.meshes.size(); ++i) {
+					deleteMeshBuffers(&objMeshes.meshes[i]);
+				}
+				objMeshes.meshes.swap(upgradedMeshes);
+				upgradedMeshes.clear();
+				logDebug("swapped in %s quality meshes after %d ms", assimpProfiles[objMeshes.profile].name, SDL_GetTicks() - loadStart);
+			}
+			if (loadFinished && frameOnLoad) {
+				frameRequested = true;
+				frameOnLoad = false;
+			}
+			if (loadFinished) {
+				SDL_WaitThread(loadThread, 0);
+				loadThread = 0;
+				logDebug("loaded in %d ms", SDL_GetTicks() - loadStart);
+			}
+		}
+
 		// draw UI before the scene
 		{
 			imguiNewFrame(mainWindow);
@@ -608,12 +1262,33 @@ int main(int argc, char *argv[])
 					| ImGuiWindowFlags_NoScrollbar
 					| ImGuiWindowFlags_NoSavedSettings
 					| ImGuiWindowFlags_NoInputs;
-			ImGui::Begin("dummy", 0, ImVec2((float)windowWidth, 20 * (objMeshes.meshes.size() + 1)), 0.0f, windowFlags);
+			ImGui::Begin("dummy", 0, ImVec2((float)windowWidth, 20 * (objMeshes.meshes.size() + 2)), 0.0f, windowFlags);
 			ImGui::Text("%.3f ms/frame (%.1f fps)", frameTime / 1000.0f, 1 / (frameTime / 1000.0f));
+			if (loadThread) {
+				SDL_LockMutex(objMeshes.lock);
+				uint32 meshesLoaded = objMeshes.meshesLoaded;
+				uint32 meshesExpected = objMeshes.meshesExpected;
+				SDL_UnlockMutex(objMeshes.lock);
+				if (meshesExpected) {
+					char overlay[64];
+					snprintf(overlay, sizeof(overlay), "%d/%d meshes", meshesLoaded, meshesExpected);
+					ImGui::ProgressBar((float)meshesLoaded / meshesExpected, ImVec2(200, 0), overlay);
+				}
+				else {
+					ImGui::Text("loading %s", objMeshes.objPath.c_str());
+				}
+				if (objMeshes.profile != AssimpProfileFast && meshesExpected && meshesLoaded == meshesExpected) {
+					ImGui::Text("loading %s quality in the background", assimpProfiles[objMeshes.profile].name);
+				}
+			}
 			ImGui::BeginChild("meshes", ImVec2((float) windowWidth, 200), false);
 			for (int i = 0; i < objMeshes.meshes.size(); ++i) {
 				Mesh* mesh = &objMeshes.meshes[i];
-				ImGui::Text("%d vertices, %d triangles", mesh->verts.size(), mesh->triangles.size() / 3);
+				uint32 firstIndex, indexCount;
+				lodIndexRange(*mesh, firstIndex, indexCount);
+				ImGui::Text("%s: %d vertices, %d triangles, lod %d/%d (%d triangles), %d bit indices", mesh->name.c_str(),
+					mesh->vertexCount(), mesh->indexCount() / 3, mesh->lodLevel, (uint32)mesh->lods.size(), indexCount / 3,
+					mesh->indexSize * 8);
 			}
 			ImGui::EndChild();
 			ImGui::End();
@@ -625,6 +1300,9 @@ int main(int argc, char *argv[])
 				mv = view * model;
 				mvp = projection * mv;
 			}
+			if (ImGui::Button("frame model")) {
+				frameRequested = true;
+			}
 			ImGui::BeginGroup();
 			ImGui::Text("Model Orientation");
 			int newUpVector = upVector;
@@ -656,24 +1334,28 @@ int main(int argc, char *argv[])
 				mvp = projection * mv;
 			}
 			ImGui::EndGroup();
-//			if (mesh && ImGui::Checkbox("Flat Shaded", &flatShading)) {
-//				shareVertices(*mesh, !flatShading);
-//				computeNormals(mesh->verts, mesh->triangles);
-//				glBindVertexArray(vao);
-//				// one vbo contains both vert locations and normals
-//				glBindBuffer(GL_ARRAY_BUFFER, vbo);
-//				glBufferData(GL_ARRAY_BUFFER, mesh->verts.size() * sizeof(Vertex), &mesh->verts[0], GL_STATIC_DRAW);
-//				// positions bound to attrib 0
-//				glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
-//				glEnableVertexAttribArray(0);
-//				// normals bound to attrib 1
-//				glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)sizeof(glm::vec3));
-//				glEnableVertexAttribArray(1);
-//				// bind the triangle indices
-//				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-//				glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->triangles.size() * sizeof(uint32), &mesh->triangles[0], GL_STATIC_DRAW);
-//				glBindVertexArray(0);
-//			}
+			ImGui::Checkbox("flat shaded", &flatShading);
+			ImGui::Text("LOD");
+			ImGui::Checkbox("automatic lod", &lodSettings.enabled);
+			ImGui::SliderFloat("pixel error", &lodSettings.pixelError, 0.1f, 16.0f, "%.2f", 2.0f);
+			ImGui::SliderFloat("hysteresis", &lodSettings.hysteresis, 0.0f, 0.9f);
+			ImGui::Checkbox("triangle budget", &lodSettings.useBudget);
+			int triangleBudget = (int)lodSettings.triangleBudget;
+			if (ImGui::InputInt("##budget", &triangleBudget, 100000, 1000000)) {
+				lodSettings.triangleBudget = (uint32)std::max(triangleBudget, 0);
+			}
+			ImGui::Text("%d / %d triangles drawn", lodStats.triangles, lodStats.fullTriangles);
+			if (lodSettings.useBudget) {
+				ImGui::ProgressBar(lodSettings.triangleBudget ? (float)lodStats.triangles / lodSettings.triangleBudget : 1.0f,
+					ImVec2(200, 0), "budget");
+				ImGui::Text("%d meshes coarsened for the budget", lodStats.meshesOverBudget);
+			}
+			ImGui::Text("%d / %d meshes in view", meshesVisible, (uint32)objMeshes.meshes.size());
+			ImGui::Checkbox("meshlet culling", &meshletCulling);
+			ImGui::Checkbox("backface cone culling", &meshletConeCulling);
+			if (meshletCulling) {
+				ImGui::Text("%d / %d meshlets drawn", meshletsVisible, meshletsTotal);
+			}
 			ImGui::Text("translate sens.");
 			ImGui::SliderFloat("##tsSlider", &camera.translateSensitivity, 0.001f, 1.0f, 0, 1.0);
 			ImGui::Text("rotate sens.");
@@ -682,28 +1364,87 @@ int main(int argc, char *argv[])
 		}
 
 
+		if (frameRequested) {
+			frameRequested = false;
+			float32 distance = frameMeshes(&camera, objMeshes.meshes, model, projection);
+			if (distance > 0.0f) {
+				// keep all of it between the clip planes, at the same depth precision
+				farClip = std::max(farClip, distance * 4.0f);
+				nearClip = std::max(nearClip, farClip * 1e-4f);
+				projection = glm::perspective(glm::degrees(camera.zoom), aspect, nearClip, farClip);
+				lightPos = camera.position;
+				view = getViewMatrix(&camera);
+				mv = view * model;
+				mvp = projection * mv;
+			}
+		}
+
 		glClearDepth(1.0);
 		// Clear color buffer
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		glUseProgram(programId);
+		// cull first so the lod budget only goes to meshes that are drawn
+		glm::vec4 frustum[6];
+		frustumPlanes(mvp, frustum);
+		meshVisible.resize(objMeshes.meshes.size());
+		for (size_t i = 0; i < objMeshes.meshes.size(); ++i) {
+			const Mesh* mesh = &objMeshes.meshes[i];
+			meshVisible[i] = mesh->vbo && sphereInFrustum(frustum, mesh->bounds.center, mesh->bounds.radius);
+		}
+		selectLods(objMeshes.meshes, meshVisible, view * model, projection, (float32)windowHeight, lodSettings, lodStats);
+		glm::vec3 modelCamera = glm::vec3(glm::inverse(view * model) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+		meshesVisible = 0;
+		meshletsVisible = 0;
+		meshletsTotal = 0;
+
+		const PhongProgram& phong = phongPrograms[flatShading];
+		glUseProgram(phong.id);
 		glBindVertexArray(vao);
 		for (int i = 0; i < objMeshes.meshes.size(); ++i) {
 			Mesh* mesh = &objMeshes.meshes[i];
-			
+			if (!meshVisible[i]) {
+				continue;
+			}
+			meshesVisible++;
+
 			glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
 			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ebo);
 
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
-			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)sizeof(glm::vec3));
-
-			glUniformMatrix4fv(mId, 1, GL_FALSE, &model[0][0]);
-			glUniformMatrix4fv(mvpId, 1, GL_FALSE, &mvp[0][0]);
-			glUniform3f(lightPosId, lightPos.x, lightPos.y, lightPos.z);
-			glUniform3f(lightColorId, lightColor.x, lightColor.y, lightColor.z);
-			glUniform3f(objectColorId, objectColor.x, objectColor.y, objectColor.z);
-
-			glDrawElements(GL_TRIANGLES, mesh->triangles.size(), GL_UNSIGNED_INT, 0);
+			bindVertexAttribs(mesh);
+			bool quantized = mesh->quantized();
+			glm::vec3 positionOffset = quantized ? mesh->quantizedOffset : glm::vec3(0.0f);
+			glm::vec3 positionScale = quantized ? mesh->quantizedScale : glm::vec3(1.0f);
+			glUniform1i(phong.quantized, quantized);
+			glUniform3f(phong.positionOffset, positionOffset.x, positionOffset.y, positionOffset.z);
+			glUniform3f(phong.positionScale, positionScale.x, positionScale.y, positionScale.z);
+
+			glUniformMatrix4fv(phong.m, 1, GL_FALSE, &model[0][0]);
+			glUniformMatrix4fv(phong.mvp, 1, GL_FALSE, &mvp[0][0]);
+			glUniform3f(phong.lightPos, lightPos.x, lightPos.y, lightPos.z);
+			glUniform3f(phong.lightColor, lightColor.x, lightColor.y, lightColor.z);
+			glUniform3f(phong.objectColor, objectColor.x, objectColor.y, objectColor.z);
+
+			// meshlets are only built for the full detail triangles
+			meshletRanges.clear();
+			if (meshletCulling && mesh->lodLevel == 0 && !mesh->meshlets.empty()) {
+				meshletsVisible += cullMeshlets(*mesh, mvp, modelCamera, meshletConeCulling, meshletRanges);
+				meshletsTotal += (uint32)mesh->meshlets.size();
+			}
+			else {
+				IndexRange range;
+				lodIndexRange(*mesh, range.firstIndex, range.indexCount);
+				meshletRanges.push_back(range);
+			}
+			drawCounts.clear();
+			drawOffsets.clear();
+			for (size_t r = 0; r < meshletRanges.size(); ++r) {
+				drawCounts.push_back((GLsizei)meshletRanges[r].indexCount);
+				drawOffsets.push_back((const GLvoid*)((size_t)meshletRanges[r].firstIndex * mesh->indexSize));
+			}
+			if (!drawCounts.empty()) {
+				GLenum indexType = mesh->indexSize == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+				glMultiDrawElements(GL_TRIANGLES, &drawCounts[0], indexType, &drawOffsets[0], (GLsizei)drawCounts.size());
+			}
 		}
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -718,14 +1459,17 @@ int main(int argc, char *argv[])
 		framesCounted++;
 	}
 
+	// stop the loader between meshes rather than waiting for the whole file
+	if (loadThread) {
+		SDL_AtomicSet(&objMeshes.cancel, 1);
+		SDL_WaitThread(loadThread, 0);
+	}
+	if (objMeshes.lock) {
+		SDL_DestroyMutex(objMeshes.lock);
+	}
+
 	for (int i = 0; i < objMeshes.meshes.size(); ++i) {
-		Mesh* mesh = &objMeshes.meshes[i];
-		if (mesh->vbo) {
-			glDeleteBuffers(1, &mesh->vbo);
-		}
-		if (mesh->ebo) {
-			glDeleteBuffers(1, &mesh->ebo);
-		}
+		deleteMeshBuffers(&objMeshes.meshes[i]);
 	}
 
 	if (vao) {
@@ -3,9 +3,14 @@
 
 #define _CRT_SECURE_NO_WARNINGS 1
 
+#include "glm/vec2.hpp"
 #include "glm/vec3.hpp"
 #include "GL/glew.h"
+#include "mapped_file.h"
 
+#include <cmath>
+#include <memory>
+#include <string>
 #include <vector>
 
 typedef uint32_t uint32;
@@ -13,6 +18,20 @@ typedef int32_t int32;
 typedef float_t float32;
 typedef GLuint glid;
 
+void logError(const char* fmt, ...);
+void logDebug(const char* fmt, ...);
+
+/**
+ * @brief push_back that counts how often the vector had to reallocate, so
+ * loaders can report how well they reserved.
+ */
+template<typename T>
+inline void pushCounted(std::vector<T>& v, const T& value, uint32& reallocations)
+{
+	reallocations += v.size() == v.capacity();
+	v.push_back(value);
+}
+
 /**
  * @brief A triangle defined by indices to an external vertex list
  * and texture coords to an external tex coord list.
@@ -27,6 +46,101 @@ struct Vertex
 {
 	glm::vec3 location;
 	glm::vec3 normal;
+	glm::vec2 texCoord;
+	// tangent and bitangent sign as GL_INT_2_10_10_10_REV, see packTangent
+	uint32 tangent;
+};
+
+/**
+ * @brief Compressed Vertex for the gpu, see vertex_quantize.h.
+ */
+struct QuantizedVertex
+{
+	// 16 bit unorm position within the mesh's bounding box
+	uint16_t position[3];
+	uint16_t padding;
+	// octahedral normal, 16 bit unorm per component
+	uint16_t normal[2];
+};
+
+/**
+ * @brief The rest of a compressed Vertex, in a second stream that is only
+ * there for meshes with texture coordinates.
+ */
+struct QuantizedTangentSpace
+{
+	// same as Vertex::tangent
+	uint32 tangent;
+	// half floats
+	uint16_t texCoord[2];
+};
+
+/**
+ * @brief A lower detail version of a mesh, drawn with the same vertices.
+ */
+struct MeshLod
+{
+	// range of Mesh::lodTriangles
+	uint32 firstIndex;
+	uint32 indexCount;
+	// how far the surface may have moved from the full detail one, in
+	// model units
+	float error;
+};
+
+/**
+ * @brief A run of consecutive triangles of a mesh with its bounds, the
+ * unit the renderer culls.
+ */
+struct Meshlet
+{
+	// range of Mesh::triangles
+	uint32 firstIndex;
+	uint32 indexCount;
+	glm::vec3 center;
+	float32 radius;
+	// every triangle faces away from a camera looking at center along a
+	// direction d when dot(d, coneAxis) >= coneCutoff * |d| + radius,
+	// a cutoff of 1 never culls
+	glm::vec3 coneAxis;
+	float32 coneCutoff;
+};
+
+/**
+ * @brief Axis aligned box and bounding sphere of a mesh's vertices, in
+ * model space, see mesh_bounds.h.
+ */
+struct MeshBounds
+{
+	glm::vec3 boxMin;
+	glm::vec3 boxMax;
+	glm::vec3 center;
+	float32 radius;
+};
+
+/**
+ * @brief Where a mesh read from the mesh cache keeps its vertex and index
+ * data, straight in the cache mapping, see readMeshCache.
+ */
+struct MeshCacheView
+{
+	// the vertex and index vectors of the mesh are empty, the counts are
+	// here instead
+	bool cached;
+	uint32 vertexCount;
+	uint32 indexCount;
+	uint32 indexSize;
+	bool quantized;
+	bool hasTangentSpace;
+	// kept alive until uploadMesh is done with it
+	std::shared_ptr<MappedFile> mapping;
+	// the MeshCacheEntry, see mesh_cache.cpp
+	const void* entry;
+	// vbo and ebo contents exactly as uploadMesh would make them
+	const char* vertexBuffer;
+	size_t vertexBufferSize;
+	const char* indexBuffer;
+	size_t indexBufferSize;
 };
 
 /**
@@ -36,11 +150,41 @@ struct Mesh
 {
 	std::vector<Vertex> verts;
 	std::vector<uint32> triangles;
+	// lods from most to least detailed, all indexing into verts
+	std::vector<uint32> lodTriangles;
+	std::vector<MeshLod> lods;
+	// clusters of triangles for culling, see meshlet.h
+	std::vector<Meshlet> meshlets;
+	// uploaded instead of verts when there are any, positions decode as
+	// quantizedOffset + position * quantizedScale
+	std::vector<QuantizedVertex> quantizedVerts;
+	// one per quantized vertex or empty, uploaded after them
+	std::vector<QuantizedTangentSpace> quantizedTangentSpace;
+	glm::vec3 quantizedOffset;
+	glm::vec3 quantizedScale;
+	// set once Vertex::tangent is filled in, see computeTangents
+	bool hasTangents;
 	std::string name;
 	glid vbo;
 	glid ebo;
+	// 2 or 4 bytes per index in ebo, set on upload
+	uint32 indexSize;
+	// set at load time, see computeMeshBounds
+	MeshBounds bounds;
+	bool hasBounds;
+	// lod drawn this frame, 0 is triangles and n is lods[n - 1]
+	uint32 lodLevel;
+	// meshStep bits of the pipeline steps already run on the mesh, see
+	// mesh_pipeline.h
+	uint32 stepsDone;
+	MeshCacheView cacheView;
 
-	bool empty() { return verts.empty(); }
+	// these work whether or not the data is still in the cache mapping
+	uint32 vertexCount() const { return cacheView.cached ? cacheView.vertexCount : (uint32)verts.size(); }
+	uint32 indexCount() const { return cacheView.cached ? cacheView.indexCount : (uint32)triangles.size(); }
+	bool quantized() const { return cacheView.cached ? cacheView.quantized : !quantizedVerts.empty(); }
+	bool hasQuantizedTangentSpace() const { return cacheView.cached ? cacheView.hasTangentSpace : !quantizedTangentSpace.empty(); }
+	bool empty() const { return vertexCount() == 0; }
 };
 
 struct Camera
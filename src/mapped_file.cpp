@@ -0,0 +1,110 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool mapFile(MappedFile& file, const std::string& path)
+{
+	file = {};
+	HANDLE fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(fileHandle, &size)) {
+		CloseHandle(fileHandle);
+		return false;
+	}
+	file.fileHandle = fileHandle;
+	if (size.QuadPart == 0) {
+		// zero length files can't be mapped
+		return true;
+	}
+
+	HANDLE mappingHandle = CreateFileMappingA(fileHandle, 0, PAGE_READONLY, 0, 0, 0);
+	if (!mappingHandle) {
+		unmapFile(file);
+		return false;
+	}
+	file.mappingHandle = mappingHandle;
+
+	file.data = (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (!file.data) {
+		unmapFile(file);
+		return false;
+	}
+	file.size = (size_t)size.QuadPart;
+	return true;
+}
+
+void unmapFile(MappedFile& file)
+{
+	if (file.data) {
+		UnmapViewOfFile(file.data);
+	}
+	if (file.mappingHandle) {
+		CloseHandle((HANDLE)file.mappingHandle);
+	}
+	if (file.fileHandle) {
+		CloseHandle((HANDLE)file.fileHandle);
+	}
+	file = {};
+}
+
+#else
+
+bool mapFile(MappedFile& file, const std::string& path)
+{
+	file = {};
+	file.fd = open(path.c_str(), O_RDONLY);
+	if (file.fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(file.fd, &st) != 0) {
+		unmapFile(file);
+		return false;
+	}
+	if (st.st_size == 0) {
+		// zero length files can't be mapped
+		return true;
+	}
+
+	void* data = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, file.fd, 0);
+	if (data == MAP_FAILED) {
+		unmapFile(file);
+		return false;
+	}
+	// the whole file is read front to back by the parsers
+	madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+	file.data = (const char*)data;
+	file.size = (size_t)st.st_size;
+	return true;
+}
+
+void unmapFile(MappedFile& file)
+{
+	if (file.data) {
+		munmap((void*)file.data, file.size);
+	}
+	// a zeroed MappedFile has fd 0, which is never handed out for a file we opened
+	if (file.fd > 0) {
+		close(file.fd);
+	}
+	file = {};
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief A read-only view of a whole file mapped into memory.
+ * The bytes are not null terminated, always use size to find the end.
+ */
+struct MappedFile
+{
+	const char* data;
+	size_t size;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#else
+	int fd;
+#endif
+};
+
+/**
+ * @brief Maps the file at path read-only. An empty file maps successfully
+ * with a null data pointer and a size of 0.
+ * @return false if the file could not be opened or mapped
+ */
+bool mapFile(MappedFile& file, const std::string& path);
+
+void unmapFile(MappedFile& file);
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,182 @@
+#include "mapped_io.h"
+#include "mapped_file.h"
+#include "main.h"
+#include "sdl.h"
+
+#include <map>
+#include <cstring>
+#include <sys/stat.h>
+
+namespace {
+
+struct SharedMapping
+{
+	MappedFile file;
+	uint32 refs;
+};
+
+// guards mappings, imports on different threads open files concurrently
+SDL_SpinLock mappingsLock = 0;
+std::map<std::string, SharedMapping*> mappings;
+
+SharedMapping* acquireMapping(const std::string& path)
+{
+	SDL_AtomicLock(&mappingsLock);
+	std::map<std::string, SharedMapping*>::iterator it = mappings.find(path);
+	SharedMapping* mapping = it != mappings.end() ? it->second : 0;
+	if (mapping) {
+		mapping->refs++;
+	}
+	SDL_AtomicUnlock(&mappingsLock);
+	if (mapping) {
+		return mapping;
+	}
+
+	// map outside the lock, it can take a while for a big file on a slow disk
+	MappedFile file;
+	if (!mapFile(file, path)) {
+		return 0;
+	}
+	bool inserted = false;
+	SDL_AtomicLock(&mappingsLock);
+	it = mappings.find(path);
+	if (it != mappings.end()) {
+		// another thread got there first, use its mapping
+		mapping = it->second;
+		mapping->refs++;
+	}
+	else {
+		mapping = new SharedMapping();
+		mapping->file = file;
+		mapping->refs = 1;
+		mappings[path] = mapping;
+		inserted = true;
+	}
+	SDL_AtomicUnlock(&mappingsLock);
+	if (!inserted) {
+		unmapFile(file);
+	}
+	return mapping;
+}
+
+void releaseMapping(const std::string& path)
+{
+	SharedMapping* unused = 0;
+	SDL_AtomicLock(&mappingsLock);
+	std::map<std::string, SharedMapping*>::iterator it = mappings.find(path);
+	if (it != mappings.end() && --it->second->refs == 0) {
+		unused = it->second;
+		mappings.erase(it);
+	}
+	SDL_AtomicUnlock(&mappingsLock);
+	if (unused) {
+		unmapFile(unused->file);
+		delete unused;
+	}
+}
+
+class MappedIOStream : public Assimp::IOStream
+{
+public:
+	MappedIOStream(const std::string& path, const SharedMapping* mapping)
+		: path(path), data(mapping->file.data), size(mapping->file.size), position(0)
+	{
+	}
+
+	~MappedIOStream()
+	{
+		releaseMapping(path);
+	}
+
+	size_t Read(void* buffer, size_t elementSize, size_t count)
+	{
+		if (elementSize == 0) {
+			return 0;
+		}
+		size_t available = (size - position) / elementSize;
+		count = count < available ? count : available;
+		if (count == 0) {
+			return 0;
+		}
+		memcpy(buffer, data + position, count * elementSize);
+		position += count * elementSize;
+		return count;
+	}
+
+	size_t Write(const void* /*buffer*/, size_t /*elementSize*/, size_t /*count*/)
+	{
+		return 0;
+	}
+
+	aiReturn Seek(size_t offset, aiOrigin origin)
+	{
+		// offsets from the end are negative, wrapped around in a size_t
+		size_t target = offset;
+		if (origin == aiOrigin_CUR) {
+			target = position + offset;
+		}
+		else if (origin == aiOrigin_END) {
+			target = size + offset;
+		}
+		if (target > size) {
+			return aiReturn_FAILURE;
+		}
+		position = target;
+		return aiReturn_SUCCESS;
+	}
+
+	size_t Tell() const
+	{
+		return position;
+	}
+
+	size_t FileSize() const
+	{
+		return size;
+	}
+
+	void Flush()
+	{
+	}
+
+private:
+	std::string path;
+	const char* data;
+	size_t size;
+	size_t position;
+};
+
+} // namespace
+
+bool MappedIOSystem::Exists(const char* path) const
+{
+	struct stat st;
+	return stat(path, &st) == 0;
+}
+
+char MappedIOSystem::getOsSeparator() const
+{
+#ifdef _WIN32
+	return '\\';
+#else
+	return '/';
+#endif
+}
+
+Assimp::IOStream* MappedIOSystem::Open(const char* path, const char* mode)
+{
+	if (strchr(mode, 'w') || strchr(mode, 'a') || strchr(mode, '+')) {
+		logError("Can't open %s for writing through a mapping", path);
+		return 0;
+	}
+	SharedMapping* mapping = acquireMapping(path);
+	if (!mapping) {
+		return 0;
+	}
+	return new MappedIOStream(path, mapping);
+}
+
+void MappedIOSystem::Close(Assimp::IOStream* stream)
+{
+	delete stream;
+}
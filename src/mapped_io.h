@@ -0,0 +1,35 @@
+#ifndef MAPPED_IO_H
+#define MAPPED_IO_H
+
+#include "assimp/IOSystem.hpp"
+#include "assimp/IOStream.hpp"
+
+#include <string>
+
+/**
+ * @brief Assimp file system that serves every read straight out of a memory
+ * mapping instead of going through stdio buffers.
+ *
+ * This saves the file reads and stdio buffering, not the copy: assimp's
+ * IOStream::Read hands over a caller buffer, so each read is still a
+ * memcpy out of the mapping, and most importers read the whole file into
+ * their own buffer first anyway.
+ *
+ * Mappings live in a process wide cache keyed by path and are shared by
+ * every MappedIOSystem, so parallel imports of the same model and the
+ * companion files it pulls in (.mtl, textures) map each file once. A
+ * mapping is released when its last stream is closed. Give each Importer
+ * its own instance, the Importer deletes it.
+ *
+ * Only reading is supported, opening a file for writing fails.
+ */
+class MappedIOSystem : public Assimp::IOSystem
+{
+public:
+	bool Exists(const char* path) const;
+	char getOsSeparator() const;
+	Assimp::IOStream* Open(const char* path, const char* mode = "rb");
+	void Close(Assimp::IOStream* stream);
+};
+
+#endif // MAPPED_IO_H
@@ -43,12 +43,50 @@ $$3RD_PARTY_PATH/imgui/imgui.cpp \
 $$3RD_PARTY_PATH/imgui/imgui_draw.cpp \
 $$3RD_PARTY_PATH/imgui/ \
 imgui_impl_sdl_gl3.cpp \
-tiny_obj_loader.cpp
+index_buffer.cpp \
+index_map.cpp \
+lod_select.cpp \
+mapped_file.cpp \
+mapped_io.cpp \
+memory_stats.cpp \
+mesh_bounds.cpp \
+mesh_cache.cpp \
+mesh_normals.cpp \
+mesh_pipeline.cpp \
+mesh_simplify.cpp \
+mesh_weld.cpp \
+meshlet.cpp \
+obj_parser.cpp \
+overdraw.cpp \
+parallel.cpp \
+tiny_obj_loader.cpp \
+vertex_cache.cpp \
+vertex_quantize.cpp \
+vertex_streams.cpp
 
 HEADERS += \
 main.h \
 imgui_impl_sdl_gl3.h \
-tiny_obj_loader.h
+index_buffer.h \
+index_map.h \
+lod_select.h \
+mapped_file.h \
+mapped_io.h \
+memory_stats.h \
+mesh_bounds.h \
+mesh_cache.h \
+mesh_normals.h \
+mesh_pipeline.h \
+mesh_simplify.h \
+mesh_weld.h \
+meshlet.h \
+obj_parser.h \
+overdraw.h \
+parallel.h \
+tiny_obj_loader.h \
+vertex_cache.h \
+vertex_quantize.h \
+vertex_streams.h
 
 DISTFILES += \
 defaultfragshader.frag \
@@ -0,0 +1,101 @@
+#include "memory_stats.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+// maps GetProcessMemoryInfo to the kernel32 version, no psapi.lib needed
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#include <malloc.h>
+#else
+#include <cstdio>
+#include <cstring>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#endif
+
+#ifdef _WIN32
+
+size_t currentMemoryUsage()
+{
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return 0;
+	}
+	return counters.WorkingSetSize;
+}
+
+size_t peakMemoryUsage()
+{
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return 0;
+	}
+	return counters.PeakWorkingSetSize;
+}
+
+void resetPeakMemoryUsage()
+{
+}
+
+void trimMemory()
+{
+	_heapmin();
+}
+
+#else
+
+/**
+ * Reads a "<field>: <n> kB" line from /proc/self/status.
+ */
+static size_t readProcStatus(const char* field)
+{
+	FILE* file = fopen("/proc/self/status", "r");
+	if (!file) {
+		return 0;
+	}
+	size_t fieldLength = strlen(field);
+	size_t value = 0;
+	char line[256];
+	while (fgets(line, sizeof(line), file)) {
+		if (strncmp(line, field, fieldLength) == 0 && line[fieldLength] == ':') {
+			unsigned long long kb = 0;
+			sscanf(line + fieldLength + 1, "%llu", &kb);
+			value = (size_t)kb * 1024;
+			break;
+		}
+	}
+	fclose(file);
+	return value;
+}
+
+size_t currentMemoryUsage()
+{
+	return readProcStatus("VmRSS");
+}
+
+size_t peakMemoryUsage()
+{
+	return readProcStatus("VmHWM");
+}
+
+void resetPeakMemoryUsage()
+{
+	// writing 5 to clear_refs resets VmHWM to the current rss
+	FILE* file = fopen("/proc/self/clear_refs", "w");
+	if (file) {
+		fputs("5", file);
+		fclose(file);
+	}
+}
+
+void trimMemory()
+{
+#ifdef __GLIBC__
+	malloc_trim(0);
+#endif
+}
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef MEMORY_STATS_H
+#define MEMORY_STATS_H
+
+#include <cstddef>
+
+/**
+ * @brief Resident memory of the process in bytes, 0 where unsupported.
+ */
+size_t currentMemoryUsage();
+
+/**
+ * @brief Highest resident memory of the process in bytes since it started
+ * or since the last resetPeakMemoryUsage, 0 where unsupported.
+ */
+size_t peakMemoryUsage();
+
+/**
+ * @brief Restarts peak tracking where the platform allows it (linux), so
+ * the peak of a single load can be measured. Elsewhere the peak stays the
+ * process wide high water mark.
+ */
+void resetPeakMemoryUsage();
+
+/**
+ * @brief Hands memory freed by the heap back to the OS so a big import
+ * doesn't keep the process at its peak.
+ */
+void trimMemory();
+
+#endif // MEMORY_STATS_H
@@ -0,0 +1,223 @@
+#include "mesh_bounds.h"
+
+#include "glm/common.hpp"
+#include "glm/geometric.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#ifdef VERTEX_STREAMS_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef VERTEX_STREAMS_AVX2
+#include <immintrin.h>
+#endif
+
+#ifdef VERTEX_STREAMS_AVX2
+AVX2_FUNCTION static void computeBoxAvx2(const VertexStreams& streams, glm::vec3& boxMin, glm::vec3& boxMax)
+{
+	for (int a = 0; a < 3; ++a) {
+		const float* values = streams.location[a];
+		__m256 low = _mm256_load_ps(values);
+		__m256 high = low;
+		for (size_t i = vertexStreamBatch; i < streams.paddedCount; i += vertexStreamBatch) {
+			__m256 v = _mm256_load_ps(values + i);
+			low = _mm256_min_ps(low, v);
+			high = _mm256_max_ps(high, v);
+		}
+		float lows[8], highs[8];
+		_mm256_storeu_ps(lows, low);
+		_mm256_storeu_ps(highs, high);
+		boxMin[a] = *std::min_element(lows, lows + 8);
+		boxMax[a] = *std::max_element(highs, highs + 8);
+	}
+}
+
+AVX2_FUNCTION static float farthestDistance2Avx2(const VertexStreams& streams, const glm::vec3& center)
+{
+	const __m256 cx = _mm256_set1_ps(center.x);
+	const __m256 cy = _mm256_set1_ps(center.y);
+	const __m256 cz = _mm256_set1_ps(center.z);
+	__m256 farthest = _mm256_setzero_ps();
+	for (size_t i = 0; i < streams.paddedCount; i += vertexStreamBatch) {
+		__m256 x = _mm256_sub_ps(_mm256_load_ps(streams.location[0] + i), cx);
+		__m256 y = _mm256_sub_ps(_mm256_load_ps(streams.location[1] + i), cy);
+		__m256 z = _mm256_sub_ps(_mm256_load_ps(streams.location[2] + i), cz);
+		__m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+		farthest = _mm256_max_ps(farthest, d2);
+	}
+	float lanes[8];
+	_mm256_storeu_ps(lanes, farthest);
+	return *std::max_element(lanes, lanes + 8);
+}
+#endif
+
+static void computeBox(const VertexStreams& streams, glm::vec3& boxMin, glm::vec3& boxMax)
+{
+#ifdef VERTEX_STREAMS_AVX2
+	if (useAvx2()) {
+		computeBoxAvx2(streams, boxMin, boxMax);
+		return;
+	}
+#endif
+	for (int a = 0; a < 3; ++a) {
+		const float* values = streams.location[a];
+#ifdef VERTEX_STREAMS_SSE2
+		// two registers per batch of eight
+		__m128 low = _mm_min_ps(_mm_load_ps(values), _mm_load_ps(values + 4));
+		__m128 high = _mm_max_ps(_mm_load_ps(values), _mm_load_ps(values + 4));
+		for (size_t i = vertexStreamBatch; i < streams.paddedCount; i += 4) {
+			__m128 v = _mm_load_ps(values + i);
+			low = _mm_min_ps(low, v);
+			high = _mm_max_ps(high, v);
+		}
+		float lows[4], highs[4];
+		_mm_storeu_ps(lows, low);
+		_mm_storeu_ps(highs, high);
+		boxMin[a] = *std::min_element(lows, lows + 4);
+		boxMax[a] = *std::max_element(highs, highs + 4);
+#else
+		boxMin[a] = *std::min_element(values, values + streams.count);
+		boxMax[a] = *std::max_element(values, values + streams.count);
+#endif
+	}
+}
+
+/**
+ * Distance from center to the farthest vertex.
+ */
+static float32 farthestDistance(const VertexStreams& streams, const glm::vec3& center)
+{
+	float distance2 = 0.0f;
+#ifdef VERTEX_STREAMS_AVX2
+	if (useAvx2()) {
+		return std::sqrt(farthestDistance2Avx2(streams, center));
+	}
+#endif
+#ifdef VERTEX_STREAMS_SSE2
+	const __m128 cx = _mm_set1_ps(center.x);
+	const __m128 cy = _mm_set1_ps(center.y);
+	const __m128 cz = _mm_set1_ps(center.z);
+	__m128 farthest = _mm_setzero_ps();
+	for (size_t i = 0; i < streams.paddedCount; i += 4) {
+		__m128 x = _mm_sub_ps(_mm_load_ps(streams.location[0] + i), cx);
+		__m128 y = _mm_sub_ps(_mm_load_ps(streams.location[1] + i), cy);
+		__m128 z = _mm_sub_ps(_mm_load_ps(streams.location[2] + i), cz);
+		__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+		farthest = _mm_max_ps(farthest, d2);
+	}
+	float lanes[4];
+	_mm_storeu_ps(lanes, farthest);
+	distance2 = *std::max_element(lanes, lanes + 4);
+#else
+	for (size_t i = 0; i < streams.count; ++i) {
+		glm::vec3 d = streamLocation(streams, i) - center;
+		distance2 = std::max(distance2, glm::dot(d, d));
+	}
+#endif
+	return std::sqrt(distance2);
+}
+
+/**
+ * Ritter's sphere center, starting from the vertices at both ends of the
+ * box's longest axis and growing the sphere to take in every vertex.
+ */
+static glm::vec3 ritterCenter(const VertexStreams& streams, const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+	glm::vec3 extent = boxMax - boxMin;
+	int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+	const float* values = streams.location[axis];
+	size_t count = streams.count;
+	size_t low = std::find(values, values + count, boxMin[axis]) - values;
+	size_t high = std::find(values, values + count, boxMax[axis]) - values;
+	if (low == count || high == count) {
+		// only with nan coordinates
+		return (boxMin + boxMax) * 0.5f;
+	}
+	glm::vec3 center = (streamLocation(streams, low) + streamLocation(streams, high)) * 0.5f;
+	float32 radius = glm::length(streamLocation(streams, high) - streamLocation(streams, low)) * 0.5f;
+	for (size_t i = 0; i < count; ++i) {
+		glm::vec3 d = streamLocation(streams, i) - center;
+		float32 distance = glm::length(d);
+		if (distance > radius) {
+			// move the center just far enough to touch the vertex
+			float32 grown = (radius + distance) * 0.5f;
+			center += d * ((grown - radius) / distance);
+			radius = grown;
+		}
+	}
+	return center;
+}
+
+void computeBounds(const VertexStreams& streams, MeshBounds& bounds)
+{
+	if (!streams.count) {
+		bounds.boxMin = bounds.boxMax = bounds.center = glm::vec3(0.0f);
+		bounds.radius = 0.0f;
+		return;
+	}
+	computeBox(streams, bounds.boxMin, bounds.boxMax);
+	glm::vec3 boxCenter = (bounds.boxMin + bounds.boxMax) * 0.5f;
+	glm::vec3 ritter = ritterCenter(streams, bounds.boxMin, bounds.boxMax);
+	float32 boxRadius = farthestDistance(streams, boxCenter);
+	float32 ritterRadius = farthestDistance(streams, ritter);
+	bool useRitter = ritterRadius < boxRadius;
+	bounds.center = useRitter ? ritter : boxCenter;
+	bounds.radius = useRitter ? ritterRadius : boxRadius;
+}
+
+void computeMeshBounds(Mesh& mesh)
+{
+	VertexStreams streams = {};
+	buildVertexStreams(streams, mesh.verts.data(), mesh.verts.size());
+	computeBounds(streams, mesh.bounds);
+	mesh.hasBounds = true;
+	freeVertexStreams(streams);
+}
+
+MeshBounds mergeBounds(const MeshBounds& a, const MeshBounds& b)
+{
+	MeshBounds merged;
+	merged.boxMin = glm::min(a.boxMin, b.boxMin);
+	merged.boxMax = glm::max(a.boxMax, b.boxMax);
+	glm::vec3 d = b.center - a.center;
+	float32 distance = glm::length(d);
+	if (distance + b.radius <= a.radius) {
+		merged.center = a.center;
+		merged.radius = a.radius;
+	}
+	else if (distance + a.radius <= b.radius) {
+		merged.center = b.center;
+		merged.radius = b.radius;
+	}
+	else {
+		merged.radius = (distance + a.radius + b.radius) * 0.5f;
+		merged.center = a.center + d * ((merged.radius - a.radius) / distance);
+	}
+	return merged;
+}
+
+void frustumPlanes(const glm::mat4& mvp, glm::vec4 planes[6])
+{
+	for (int i = 0; i < 3; ++i) {
+		for (int side = 0; side < 2; ++side) {
+			glm::vec4 plane;
+			for (int c = 0; c < 4; ++c) {
+				plane[c] = mvp[c][3] + (side ? -mvp[c][i] : mvp[c][i]);
+			}
+			float32 length = glm::length(glm::vec3(plane));
+			planes[i * 2 + side] = length > 0.0f ? plane / length : plane;
+		}
+	}
+}
+
+bool sphereInFrustum(const glm::vec4 planes[6], const glm::vec3& center, float32 radius)
+{
+	for (int p = 0; p < 6; ++p) {
+		if (glm::dot(glm::vec3(planes[p]), center) + planes[p].w < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
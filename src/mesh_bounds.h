@@ -0,0 +1,43 @@
+#ifndef MESH_BOUNDS_H
+#define MESH_BOUNDS_H
+
+#include "main.h"
+#include "vertex_streams.h"
+
+#include "glm/mat4x4.hpp"
+#include "glm/vec4.hpp"
+
+/**
+ * @brief Computes the axis aligned box and a bounding sphere of the
+ * vertices. The sphere is the smaller of the one around the box center and
+ * Ritter's sphere, both with their radius measured exactly, so it is never
+ * bigger than the box's circumsphere. No vertices give an empty box at the
+ * origin.
+ */
+void computeBounds(const VertexStreams& streams, MeshBounds& bounds);
+
+/**
+ * @brief Sets mesh.bounds from its vertices, building streams just for
+ * that. The mesh pipeline does this for every mesh with the streams it
+ * shares between kernels, meshes from the mesh cache come with theirs.
+ */
+void computeMeshBounds(Mesh& mesh);
+
+/**
+ * @brief Bounds containing both a and b, e.g. of a whole model.
+ */
+MeshBounds mergeBounds(const MeshBounds& a, const MeshBounds& b);
+
+/**
+ * @brief The six frustum planes of a (model view) projection matrix
+ * (Gribb and Hartmann), normalized so distances are in model units and
+ * pointing inwards.
+ */
+void frustumPlanes(const glm::mat4& mvp, glm::vec4 planes[6]);
+
+/**
+ * @brief False when the sphere is entirely outside one of the planes.
+ */
+bool sphereInFrustum(const glm::vec4 planes[6], const glm::vec3& center, float32 radius);
+
+#endif // MESH_BOUNDS_H
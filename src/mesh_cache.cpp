@@ -0,0 +1,478 @@
+#include "mesh_cache.h"
+#include "mapped_file.h"
+#include "index_buffer.h"
+#include "sdl.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+
+// bump whenever the layout below, the Vertex, QuantizedVertex,
+// QuantizedTangentSpace, MeshLod, Meshlet or MeshBounds structs or the
+// pipeline's meshStep bits change
+static const uint32 meshCacheVersion = 9;
+static const char meshCacheMagic[8] = { 'M', 'V', 'C', 'A', 'C', 'H', 'E', 0 };
+static const uint64_t meshCacheAlignment = 16;
+
+/**
+ * The file starts with the header and the source path, followed by the
+ * vertex, index, lod, meshlet, quantized vertex, quantized tangent space
+ * and name blobs of each mesh and finally one entry per mesh.
+ * The entries go last so meshes can be appended as they are loaded. All
+ * offsets are from the start of the file so the whole thing can be used
+ * straight from a mapping wherever it lands.
+ * The index blob holds the triangles followed by the lod triangles in the
+ * index size the renderer uses, and the quantized tangent space directly
+ * follows the quantized vertices, so both are ready for glBufferData.
+ */
+struct MeshCacheHeader
+{
+	char magic[8];
+	uint32 version;
+	uint32 vertexSize;
+	uint64_t sourceSize;
+	int64_t sourceMtime;
+	uint64_t sourceHash;
+	uint64_t entriesOffset;
+	uint32 sourcePathLength;
+	uint32 meshCount;
+};
+
+struct MeshCacheEntry
+{
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint64_t lodOffset;
+	uint64_t meshletOffset;
+	uint64_t quantizedOffset;
+	uint64_t tangentSpaceOffset;
+	uint64_t nameOffset;
+	uint32 vertexCount;
+	uint32 indexCount;
+	uint32 lodIndexCount;
+	uint32 indexSize;
+	uint32 lodCount;
+	uint32 meshletCount;
+	uint32 quantizedCount;
+	uint32 tangentSpaceCount;
+	uint32 nameLength;
+	uint32 flags;
+	// Mesh::stepsDone, the pipeline skips those steps for cached meshes
+	uint32 stepsDone;
+	MeshBounds bounds;
+	glm::vec3 quantizedPositionOffset;
+	glm::vec3 quantizedPositionScale;
+};
+
+// MeshCacheEntry::flags
+static const uint32 meshCacheHasTangents = 1;
+static const uint32 meshCacheHasBounds = 2;
+
+struct MeshCacheKey
+{
+	uint64_t size;
+	int64_t mtime;
+	uint64_t hash;
+};
+
+static std::string meshCachePath(const std::string& sourcePath, const std::string& variant)
+{
+	return variant.empty() ? sourcePath + ".mvcache" : sourcePath + "." + variant + ".mvcache";
+}
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+/**
+ * Hashes 32 bytes per step in four independent lanes so it runs close to
+ * memory bandwidth, this is only used to detect a changed source file.
+ */
+static uint64_t hashBytes(const char* data, size_t size)
+{
+	const uint64_t prime1 = 0x9E3779B185EBCA87ull;
+	const uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+	uint64_t lanes[4] = { prime1, prime2, prime1 ^ prime2, ~prime1 };
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32) {
+		for (int l = 0; l < 4; ++l) {
+			uint64_t v;
+			memcpy(&v, data + i + l * 8, 8);
+			lanes[l] = rotl64(lanes[l] + v * prime2, 31) * prime1;
+		}
+	}
+	uint64_t hash = rotl64(lanes[0], 1) + rotl64(lanes[1], 7) + rotl64(lanes[2], 12) + rotl64(lanes[3], 18);
+	for (; i < size; ++i) {
+		hash = rotl64(hash ^ ((uint8_t)data[i] * prime1), 11) * prime2;
+	}
+	hash ^= size;
+	hash ^= hash >> 33;
+	hash *= prime2;
+	hash ^= hash >> 29;
+	return hash;
+}
+
+static bool statSource(const std::string& sourcePath, MeshCacheKey& key)
+{
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_stat64(sourcePath.c_str(), &st) != 0) {
+		return false;
+	}
+#else
+	struct stat st;
+	if (stat(sourcePath.c_str(), &st) != 0) {
+		return false;
+	}
+#endif
+	key.size = (uint64_t)st.st_size;
+	key.mtime = (int64_t)st.st_mtime;
+	return true;
+}
+
+static bool hashSource(const std::string& sourcePath, uint64_t& hash)
+{
+	MappedFile source;
+	if (!mapFile(source, sourcePath)) {
+		return false;
+	}
+	hash = hashBytes(source.data, source.size);
+	unmapFile(source);
+	return true;
+}
+
+static bool getSourceKey(const std::string& sourcePath, MeshCacheKey& key)
+{
+	return statSource(sourcePath, key) && hashSource(sourcePath, key.hash);
+}
+
+/**
+ * Whether count elements of elementSize at offset lie within a cache of
+ * cacheSize bytes, without overflowing on the values of a corrupt file,
+ * and are aligned well enough to be read in place.
+ */
+static inline bool blobInCache(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t cacheSize)
+{
+	return offset <= cacheSize
+		&& count <= (cacheSize - offset) / elementSize
+		&& offset % std::min(elementSize, (uint64_t)4) == 0;
+}
+
+static inline uint64_t alignOffset(uint64_t offset)
+{
+	return (offset + meshCacheAlignment - 1) & ~(meshCacheAlignment - 1);
+}
+
+bool readMeshCache(const std::string& sourcePath, std::vector<Mesh>& meshes, const std::string& variant)
+{
+	MappedFile cache;
+	if (!mapFile(cache, meshCachePath(sourcePath, variant))) {
+		return false;
+	}
+
+	bool valid = cache.size >= sizeof(MeshCacheHeader);
+	const MeshCacheHeader* header = (const MeshCacheHeader*)cache.data;
+	valid = valid
+		&& memcmp(header->magic, meshCacheMagic, sizeof(meshCacheMagic)) == 0
+		&& header->version == meshCacheVersion
+		&& header->vertexSize == sizeof(Vertex)
+		&& sizeof(MeshCacheHeader) + (uint64_t)header->sourcePathLength <= cache.size
+		&& sourcePath.size() == header->sourcePathLength
+		&& memcmp(cache.data + sizeof(MeshCacheHeader), sourcePath.data(), sourcePath.size()) == 0;
+
+	// the size and modification time are enough to trust the cache, the
+	// contents are only hashed when the source was touched without
+	// changing size, e.g. copied or saved again
+	MeshCacheKey key;
+	valid = valid
+		&& statSource(sourcePath, key)
+		&& key.size == header->sourceSize;
+	if (valid && key.mtime != header->sourceMtime) {
+		valid = hashSource(sourcePath, key.hash) && key.hash == header->sourceHash;
+		if (valid) {
+			logDebug("%s was touched but is unchanged, using its mesh cache", sourcePath.c_str());
+		}
+	}
+
+	const MeshCacheEntry* entries = 0;
+	if (valid) {
+		entries = (const MeshCacheEntry*)(cache.data + header->entriesOffset);
+		valid = blobInCache(header->entriesOffset, header->meshCount, sizeof(MeshCacheEntry), cache.size)
+			&& header->entriesOffset % meshCacheAlignment == 0;
+		for (uint32 i = 0; valid && i < header->meshCount; ++i) {
+			const MeshCacheEntry& entry = entries[i];
+			uint64_t indexCount = (uint64_t)entry.indexCount + entry.lodIndexCount;
+			valid = (entry.indexSize == sizeof(uint16_t) || entry.indexSize == sizeof(uint32))
+				&& (entry.quantizedCount == 0 || entry.quantizedCount == entry.vertexCount)
+				&& (entry.tangentSpaceCount == 0 || (entry.tangentSpaceCount == entry.quantizedCount
+					&& entry.tangentSpaceOffset == entry.quantizedOffset + (uint64_t)entry.quantizedCount * sizeof(QuantizedVertex)))
+				&& blobInCache(entry.vertexOffset, entry.vertexCount, sizeof(Vertex), cache.size)
+				&& blobInCache(entry.indexOffset, indexCount, entry.indexSize, cache.size)
+				&& blobInCache(entry.lodOffset, entry.lodCount, sizeof(MeshLod), cache.size)
+				&& blobInCache(entry.meshletOffset, entry.meshletCount, sizeof(Meshlet), cache.size)
+				&& blobInCache(entry.quantizedOffset, entry.quantizedCount, sizeof(QuantizedVertex), cache.size)
+				&& blobInCache(entry.tangentSpaceOffset, entry.tangentSpaceCount, sizeof(QuantizedTangentSpace), cache.size)
+				&& blobInCache(entry.nameOffset, entry.nameLength, 1, cache.size);
+		}
+	}
+	if (!valid) {
+		unmapFile(cache);
+		logDebug("no valid mesh cache for %s", sourcePath.c_str());
+		return false;
+	}
+
+	// the small per mesh data is copied, the vertex and index data stays
+	// in the mapping until it's uploaded, see loadCachedMeshData
+	std::shared_ptr<MappedFile> mapping(new MappedFile(cache), [](MappedFile* file) {
+		unmapFile(*file);
+		delete file;
+	});
+	for (uint32 i = 0; i < header->meshCount; ++i) {
+		const MeshCacheEntry& entry = entries[i];
+		Mesh mesh = {};
+		const MeshLod* lods = (const MeshLod*)(cache.data + entry.lodOffset);
+		const Meshlet* meshlets = (const Meshlet*)(cache.data + entry.meshletOffset);
+		mesh.lods.assign(lods, lods + entry.lodCount);
+		mesh.meshlets.assign(meshlets, meshlets + entry.meshletCount);
+		mesh.quantizedOffset = entry.quantizedPositionOffset;
+		mesh.quantizedScale = entry.quantizedPositionScale;
+		mesh.name.assign(cache.data + entry.nameOffset, entry.nameLength);
+		mesh.hasTangents = (entry.flags & meshCacheHasTangents) != 0;
+		mesh.hasBounds = (entry.flags & meshCacheHasBounds) != 0;
+		mesh.bounds = entry.bounds;
+		mesh.stepsDone = entry.stepsDone;
+
+		MeshCacheView& view = mesh.cacheView;
+		view.cached = true;
+		view.vertexCount = entry.vertexCount;
+		view.indexCount = entry.indexCount;
+		view.indexSize = entry.indexSize;
+		view.quantized = entry.quantizedCount > 0;
+		view.hasTangentSpace = entry.tangentSpaceCount > 0;
+		view.mapping = mapping;
+		view.entry = &entry;
+		if (view.quantized) {
+			view.vertexBuffer = cache.data + entry.quantizedOffset;
+			view.vertexBufferSize = entry.quantizedCount * sizeof(QuantizedVertex)
+				+ entry.tangentSpaceCount * sizeof(QuantizedTangentSpace);
+		}
+		else {
+			view.vertexBuffer = cache.data + entry.vertexOffset;
+			view.vertexBufferSize = entry.vertexCount * sizeof(Vertex);
+		}
+		view.indexBuffer = cache.data + entry.indexOffset;
+		view.indexBufferSize = (size_t)(((uint64_t)entry.indexCount + entry.lodIndexCount) * entry.indexSize);
+		meshes.push_back(std::move(mesh));
+	}
+	logDebug("loaded %d meshes from mesh cache", header->meshCount);
+	return true;
+}
+
+void loadCachedMeshData(Mesh& mesh)
+{
+	MeshCacheView& view = mesh.cacheView;
+	if (!view.mapping) {
+		return;
+	}
+	const MeshCacheEntry& entry = *(const MeshCacheEntry*)view.entry;
+	const char* data = view.mapping->data;
+	const Vertex* verts = (const Vertex*)(data + entry.vertexOffset);
+	mesh.verts.assign(verts, verts + entry.vertexCount);
+	mesh.triangles.resize(entry.indexCount);
+	mesh.lodTriangles.resize(entry.lodIndexCount);
+	if (entry.indexSize == sizeof(uint16_t)) {
+		const uint16_t* indices = (const uint16_t*)(data + entry.indexOffset);
+		std::copy(indices, indices + entry.indexCount, mesh.triangles.begin());
+		std::copy(indices + entry.indexCount, indices + entry.indexCount + entry.lodIndexCount, mesh.lodTriangles.begin());
+	}
+	else {
+		const uint32* indices = (const uint32*)(data + entry.indexOffset);
+		std::copy(indices, indices + entry.indexCount, mesh.triangles.begin());
+		std::copy(indices + entry.indexCount, indices + entry.indexCount + entry.lodIndexCount, mesh.lodTriangles.begin());
+	}
+	const QuantizedVertex* quantizedVerts = (const QuantizedVertex*)(data + entry.quantizedOffset);
+	const QuantizedTangentSpace* tangentSpace = (const QuantizedTangentSpace*)(data + entry.tangentSpaceOffset);
+	mesh.quantizedVerts.assign(quantizedVerts, quantizedVerts + entry.quantizedCount);
+	mesh.quantizedTangentSpace.assign(tangentSpace, tangentSpace + entry.tangentSpaceCount);
+	mesh.cacheView = MeshCacheView();
+}
+
+struct MeshCacheWriter
+{
+	SDL_RWops* file;
+	std::string sourcePath;
+	std::string cachePath;
+	std::string tempPath;
+	// taken before the import reads the source, so a source edited while
+	// it's imported doesn't match the cache made from its old contents
+	MeshCacheKey key;
+	std::vector<MeshCacheEntry> entries;
+	uint64_t offset;
+	bool ok;
+};
+
+static void writeBlob(MeshCacheWriter* writer, const void* data, size_t size)
+{
+	if (writer->ok && size) {
+		writer->ok = SDL_RWwrite(writer->file, data, size, 1) == 1;
+	}
+	writer->offset += size;
+}
+
+static void writePadding(MeshCacheWriter* writer)
+{
+	static const char zeros[meshCacheAlignment] = {};
+	writeBlob(writer, zeros, (size_t)(alignOffset(writer->offset) - writer->offset));
+}
+
+MeshCacheWriter* beginMeshCache(const std::string& sourcePath, const std::string& variant)
+{
+	MeshCacheKey key;
+	if (!getSourceKey(sourcePath, key)) {
+		logError("Failed to read %s for its mesh cache", sourcePath.c_str());
+		return 0;
+	}
+	std::string cachePath = meshCachePath(sourcePath, variant);
+	std::string tempPath = cachePath + ".tmp";
+	SDL_RWops* file = SDL_RWFromFile(tempPath.c_str(), "wb");
+	if (!file) {
+		logError("Failed to create mesh cache %s", tempPath.c_str());
+		return 0;
+	}
+
+	MeshCacheWriter* writer = new MeshCacheWriter();
+	writer->file = file;
+	writer->sourcePath = sourcePath;
+	writer->cachePath = cachePath;
+	writer->tempPath = tempPath;
+	writer->key = key;
+	writer->offset = 0;
+	writer->ok = true;
+
+	// the real header is written by finishMeshCache
+	MeshCacheHeader header = {};
+	writeBlob(writer, &header, sizeof(header));
+	writeBlob(writer, sourcePath.data(), sourcePath.size());
+	return writer;
+}
+
+void addMeshToCache(MeshCacheWriter* writer, const Mesh& mesh)
+{
+	if (!writer) {
+		return;
+	}
+	if (mesh.cacheView.cached) {
+		// only happens if a mesh from one cache is written to another
+		logError("Mesh %s is still in a mesh cache mapping, not caching it", mesh.name.c_str());
+		writer->ok = false;
+		return;
+	}
+	MeshCacheEntry entry = {};
+	entry.vertexCount = (uint32)mesh.verts.size();
+	entry.indexCount = (uint32)mesh.triangles.size();
+	entry.lodIndexCount = (uint32)mesh.lodTriangles.size();
+	entry.indexSize = meshIndexSize(mesh);
+	entry.lodCount = (uint32)mesh.lods.size();
+	entry.meshletCount = (uint32)mesh.meshlets.size();
+	entry.quantizedCount = (uint32)mesh.quantizedVerts.size();
+	entry.tangentSpaceCount = (uint32)mesh.quantizedTangentSpace.size();
+	entry.nameLength = (uint32)mesh.name.size();
+	entry.flags = (mesh.hasTangents ? meshCacheHasTangents : 0) | (mesh.hasBounds ? meshCacheHasBounds : 0);
+	entry.stepsDone = mesh.stepsDone;
+	entry.bounds = mesh.bounds;
+	entry.quantizedPositionOffset = mesh.quantizedOffset;
+	entry.quantizedPositionScale = mesh.quantizedScale;
+
+	writePadding(writer);
+	entry.vertexOffset = writer->offset;
+	writeBlob(writer, mesh.verts.data(), mesh.verts.size() * sizeof(Vertex));
+	writePadding(writer);
+	entry.indexOffset = writer->offset;
+	if (entry.indexSize == sizeof(uint16_t)) {
+		std::vector<uint16_t> packed(mesh.triangles.size() + mesh.lodTriangles.size());
+		if (!mesh.triangles.empty()) {
+			packIndices16(mesh.triangles.data(), entry.indexCount, packed.data());
+		}
+		if (!mesh.lodTriangles.empty()) {
+			packIndices16(mesh.lodTriangles.data(), entry.lodIndexCount, packed.data() + entry.indexCount);
+		}
+		writeBlob(writer, packed.data(), packed.size() * sizeof(uint16_t));
+	}
+	else {
+		writeBlob(writer, mesh.triangles.data(), mesh.triangles.size() * sizeof(uint32));
+		writeBlob(writer, mesh.lodTriangles.data(), mesh.lodTriangles.size() * sizeof(uint32));
+	}
+	writePadding(writer);
+	entry.lodOffset = writer->offset;
+	writeBlob(writer, mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod));
+	writePadding(writer);
+	entry.meshletOffset = writer->offset;
+	writeBlob(writer, mesh.meshlets.data(), mesh.meshlets.size() * sizeof(Meshlet));
+	writePadding(writer);
+	entry.quantizedOffset = writer->offset;
+	writeBlob(writer, mesh.quantizedVerts.data(), mesh.quantizedVerts.size() * sizeof(QuantizedVertex));
+	// no padding, the two make up the vbo together
+	entry.tangentSpaceOffset = writer->offset;
+	writeBlob(writer, mesh.quantizedTangentSpace.data(), mesh.quantizedTangentSpace.size() * sizeof(QuantizedTangentSpace));
+	writePadding(writer);
+	entry.nameOffset = writer->offset;
+	writeBlob(writer, mesh.name.data(), mesh.name.size());
+	writer->entries.push_back(entry);
+}
+
+bool finishMeshCache(MeshCacheWriter* writer, bool keep)
+{
+	if (!writer) {
+		return false;
+	}
+
+	MeshCacheHeader header = {};
+	memcpy(header.magic, meshCacheMagic, sizeof(meshCacheMagic));
+	header.version = meshCacheVersion;
+	header.vertexSize = sizeof(Vertex);
+	header.sourcePathLength = (uint32)writer->sourcePath.size();
+	header.meshCount = (uint32)writer->entries.size();
+
+	writePadding(writer);
+	header.entriesOffset = writer->offset;
+	writeBlob(writer, writer->entries.data(), writer->entries.size() * sizeof(MeshCacheEntry));
+
+	bool ok = keep && writer->ok;
+	if (ok) {
+		header.sourceSize = writer->key.size;
+		header.sourceMtime = writer->key.mtime;
+		header.sourceHash = writer->key.hash;
+		ok = SDL_RWseek(writer->file, 0, RW_SEEK_SET) == 0
+			&& SDL_RWwrite(writer->file, &header, sizeof(header), 1) == 1;
+	}
+	ok = SDL_RWclose(writer->file) == 0 && ok;
+
+	const std::string& cachePath = writer->cachePath;
+	if (ok) {
+		// rename won't replace an existing file on windows
+		remove(cachePath.c_str());
+		ok = rename(writer->tempPath.c_str(), cachePath.c_str()) == 0;
+	}
+	if (!ok) {
+		remove(writer->tempPath.c_str());
+		if (keep) {
+			logError("Failed to write mesh cache %s", cachePath.c_str());
+		}
+	}
+	else {
+		logDebug("wrote mesh cache %s", cachePath.c_str());
+	}
+	delete writer;
+	return ok;
+}
+
+bool writeMeshCache(const std::string& sourcePath, const std::vector<Mesh>& meshes, const std::string& variant)
+{
+	MeshCacheWriter* writer = beginMeshCache(sourcePath, variant);
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		addMeshToCache(writer, meshes[i]);
+	}
+	return finishMeshCache(writer, true);
+}
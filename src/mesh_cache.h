@@ -0,0 +1,47 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "main.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Loads the meshes cached for sourcePath from "<sourcePath>.mvcache",
+ * or "<sourcePath>.<variant>.mvcache" when the same source is cached more
+ * than one way (e.g. per import profile).
+ * The cache is only used when it was written by this version for a source
+ * with the same path and size, and the same modification time or, failing
+ * that, the same content hash.
+ * The meshes' vertex and index data is left in the cache mapping, see
+ * Mesh::cacheView, so uploadMesh can hand it to the gpu as is.
+ * @return false on a cache miss, meshes is left untouched
+ */
+bool readMeshCache(const std::string& sourcePath, std::vector<Mesh>& meshes, const std::string& variant = std::string());
+
+/**
+ * @brief Copies the vertex and index data of a mesh from readMeshCache out
+ * of the mapping into its vectors, for pipeline steps that still have to
+ * run on it. Does nothing for other meshes.
+ */
+void loadCachedMeshData(Mesh& mesh);
+
+/**
+ * @brief Writes meshes to "<sourcePath>.mvcache" so the next load of
+ * sourcePath can skip importing. The file is written to a temporary name
+ * first so a partially written cache is never picked up.
+ */
+bool writeMeshCache(const std::string& sourcePath, const std::vector<Mesh>& meshes, const std::string& variant = std::string());
+
+/**
+ * @brief Incremental version of writeMeshCache for loaders that hand out
+ * meshes one at a time. Every writer from beginMeshCache must be passed to
+ * finishMeshCache, with keep false to throw away a cache for an import that
+ * was cancelled or failed. A null writer is ignored by both.
+ */
+struct MeshCacheWriter;
+MeshCacheWriter* beginMeshCache(const std::string& sourcePath, const std::string& variant = std::string());
+void addMeshToCache(MeshCacheWriter* writer, const Mesh& mesh);
+bool finishMeshCache(MeshCacheWriter* writer, bool keep);
+
+#endif // MESH_CACHE_H
@@ -0,0 +1,275 @@
+#include "mesh_normals.h"
+#include "parallel.h"
+#include "sdl.h"
+
+#include "glm/common.hpp"
+#include "glm/geometric.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// below this many triangles splitting the work costs more than it saves
+static const size_t minTrianglesPerTask = 1 << 16;
+
+static inline float cornerAngle(const glm::vec3& a, const glm::vec3& b)
+{
+	float lengths = glm::length(a) * glm::length(b);
+	if (lengths <= 0.0f) {
+		return 0.0f;
+	}
+	return std::acos(glm::clamp(glm::dot(a, b) / lengths, -1.0f, 1.0f));
+}
+
+/**
+ * Adds the weighted face normals of triangles [first, last) to sums.
+ */
+static void accumulateNormals(const std::vector<Vertex>& verts, const std::vector<uint32>& triangles,
+	size_t first, size_t last, NormalWeighting weighting, glm::vec3* sums)
+{
+	size_t vertCount = verts.size();
+	for (size_t i = first; i < last; ++i) {
+		uint32 i1 = triangles[i * 3 + 0];
+		uint32 i2 = triangles[i * 3 + 1];
+		uint32 i3 = triangles[i * 3 + 2];
+		if (i1 >= vertCount || i2 >= vertCount || i3 >= vertCount) {
+			continue;
+		}
+		const glm::vec3& p1 = verts[i1].location;
+		const glm::vec3& p2 = verts[i2].location;
+		const glm::vec3& p3 = verts[i3].location;
+		glm::vec3 e12 = p2 - p1;
+		glm::vec3 e23 = p3 - p2;
+		glm::vec3 e31 = p1 - p3;
+		// the cross product's length is twice the triangle's area
+		glm::vec3 normal = glm::cross(e12, e23);
+		if (weighting == NormalWeightingArea) {
+			sums[i1] += normal;
+			sums[i2] += normal;
+			sums[i3] += normal;
+		}
+		else {
+			float length = glm::length(normal);
+			if (length <= 0.0f) {
+				continue;
+			}
+			normal /= length;
+			sums[i1] += normal * cornerAngle(e12, -e31);
+			sums[i2] += normal * cornerAngle(e23, -e12);
+			sums[i3] += normal * cornerAngle(e31, -e23);
+		}
+	}
+}
+
+/**
+ * Sums a T per vertex over the triangles. Every task adds up its share of
+ * the triangles into its own accumulator with accumulate(first, last, sums),
+ * then every task totals a range of the vertices across the accumulators
+ * and hands each total to finish(vertex, sum).
+ */
+template<typename T, typename Accumulate, typename Finish>
+static void accumulatePerVertex(size_t vertCount, size_t triCount, uint32 maxThreads,
+	const Accumulate& accumulate, const Finish& finish)
+{
+	uint32 threadCount = maxThreads ? maxThreads : workerCount();
+	size_t taskCount = std::min((size_t)threadCount, std::max(triCount / minTrianglesPerTask, (size_t)1));
+
+	std::vector<std::vector<T> > sums(taskCount);
+	parallelFor((uint32)taskCount, [&](uint32 task) {
+		sums[task].assign(vertCount, T());
+		size_t first = triCount * task / taskCount;
+		size_t last = triCount * (task + 1) / taskCount;
+		accumulate(first, last, sums[task].data());
+	}, threadCount);
+
+	parallelFor((uint32)taskCount, [&](uint32 task) {
+		size_t first = vertCount * task / taskCount;
+		size_t last = vertCount * (task + 1) / taskCount;
+		for (size_t v = first; v < last; ++v) {
+			T sum = sums[0][v];
+			for (size_t t = 1; t < taskCount; ++t) {
+				sum += sums[t][v];
+			}
+			finish(v, sum);
+		}
+	}, threadCount);
+}
+
+void computeNormals(std::vector<Vertex>& verts, const std::vector<uint32>& triangles,
+	NormalWeighting weighting, uint32 maxThreads)
+{
+	accumulatePerVertex<glm::vec3>(verts.size(), triangles.size() / 3, maxThreads,
+		[&](size_t first, size_t last, glm::vec3* sums) {
+			accumulateNormals(verts, triangles, first, last, weighting, sums);
+		},
+		[&](size_t v, const glm::vec3& sum) {
+			float length = glm::length(sum);
+			verts[v].normal = length > 0.0f ? sum / length : glm::vec3(0.0f);
+		});
+}
+
+/**
+ * Angle weighted tangents of the faces around a vertex, kept apart by
+ * whether the face's texture mapping is mirrored.
+ */
+struct TangentSum
+{
+	glm::vec3 tangent[2];
+	float weight[2];
+
+	TangentSum()
+	{
+		tangent[0] = tangent[1] = glm::vec3(0.0f);
+		weight[0] = weight[1] = 0.0f;
+	}
+
+	TangentSum& operator+=(const TangentSum& other)
+	{
+		for (int i = 0; i < 2; ++i) {
+			tangent[i] += other.tangent[i];
+			weight[i] += other.weight[i];
+		}
+		return *this;
+	}
+};
+
+static inline glm::vec3 projectOnPlane(const glm::vec3& v, const glm::vec3& normal)
+{
+	return v - normal * glm::dot(normal, v);
+}
+
+static inline glm::vec3 normalizeOrZero(const glm::vec3& v)
+{
+	float length = glm::length(v);
+	return length > 0.0f ? v / length : glm::vec3(0.0f);
+}
+
+/**
+ * Adds the tangents of triangles [first, last) to sums the way MikkTSpace
+ * does: each face's texture space tangent, projected into the tangent plane
+ * of the corner's vertex normal and weighted by the corner's angle in that
+ * plane.
+ */
+static void accumulateTangents(const std::vector<Vertex>& verts, const std::vector<uint32>& triangles,
+	size_t first, size_t last, TangentSum* sums)
+{
+	size_t vertCount = verts.size();
+	for (size_t i = first; i < last; ++i) {
+		uint32 index[3] = { triangles[i * 3 + 0], triangles[i * 3 + 1], triangles[i * 3 + 2] };
+		if (index[0] >= vertCount || index[1] >= vertCount || index[2] >= vertCount) {
+			continue;
+		}
+		const Vertex& v1 = verts[index[0]];
+		const Vertex& v2 = verts[index[1]];
+		const Vertex& v3 = verts[index[2]];
+		glm::vec3 d1 = v2.location - v1.location;
+		glm::vec3 d2 = v3.location - v1.location;
+		glm::vec2 t21 = v2.texCoord - v1.texCoord;
+		glm::vec2 t31 = v3.texCoord - v1.texCoord;
+		// twice the signed area in texture space, negative when mirrored
+		float area = t21.x * t31.y - t21.y * t31.x;
+		glm::vec3 faceTangent = normalizeOrZero(d1 * t31.y - d2 * t21.y);
+		if (area == 0.0f || faceTangent == glm::vec3(0.0f)) {
+			continue;
+		}
+		int mirrored = area < 0.0f;
+		if (mirrored) {
+			faceTangent = -faceTangent;
+		}
+		for (int c = 0; c < 3; ++c) {
+			const Vertex& corner = verts[index[c]];
+			const glm::vec3& n = corner.normal;
+			glm::vec3 e1 = normalizeOrZero(projectOnPlane(verts[index[(c + 1) % 3]].location - corner.location, n));
+			glm::vec3 e2 = normalizeOrZero(projectOnPlane(verts[index[(c + 2) % 3]].location - corner.location, n));
+			float angle = std::acos(glm::clamp(glm::dot(e1, e2), -1.0f, 1.0f));
+			TangentSum& sum = sums[index[c]];
+			sum.tangent[mirrored] += normalizeOrZero(projectOnPlane(faceTangent, n)) * angle;
+			sum.weight[mirrored] += angle;
+		}
+	}
+}
+
+void computeTangents(std::vector<Vertex>& verts, const std::vector<uint32>& triangles, uint32 maxThreads)
+{
+	accumulatePerVertex<TangentSum>(verts.size(), triangles.size() / 3, maxThreads,
+		[&](size_t first, size_t last, TangentSum* sums) {
+			accumulateTangents(verts, triangles, first, last, sums);
+		},
+		[&](size_t v, const TangentSum& sum) {
+			// MikkTSpace splits a vertex used by mirrored and unmirrored faces,
+			// vertices are shared here so the side with more weight wins
+			int mirrored = sum.weight[1] > sum.weight[0];
+			glm::vec3 tangent = normalizeOrZero(sum.tangent[mirrored]);
+			const glm::vec3& n = verts[v].normal;
+			if (tangent == glm::vec3(0.0f)) {
+				// no usable texture mapping, any tangent will do
+				glm::vec3 axis = std::fabs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+				tangent = normalizeOrZero(projectOnPlane(axis, n));
+			}
+			verts[v].tangent = packTangent(tangent, mirrored ? -1.0f : 1.0f);
+		});
+}
+
+static inline uint32 packSnorm10(float v)
+{
+	int32 q = (int32)std::floor(glm::clamp(v, -1.0f, 1.0f) * 511.0f + 0.5f);
+	return (uint32)q & 0x3FF;
+}
+
+static inline float unpackSnorm10(uint32 v)
+{
+	// sign extend the 10 bits
+	int32 q = (int32)(v << 22) >> 22;
+	return std::max(q / 511.0f, -1.0f);
+}
+
+uint32 packTangent(const glm::vec3& tangent, float sign)
+{
+	uint32 w = sign < 0.0f ? 3u : 1u;
+	return packSnorm10(tangent.x) | packSnorm10(tangent.y) << 10 | packSnorm10(tangent.z) << 20 | w << 30;
+}
+
+glm::vec4 unpackTangent(uint32 packed)
+{
+	return glm::vec4(unpackSnorm10(packed), unpackSnorm10(packed >> 10), unpackSnorm10(packed >> 20),
+		packed >> 31 ? -1.0f : 1.0f);
+}
+
+void benchmarkNormals(uint32 triangleCount)
+{
+	// a wavy grid, two triangles per cell, so the normals aren't trivial
+	uint32 side = std::max((uint32)std::sqrt(triangleCount / 2.0), 2u);
+	Mesh mesh = {};
+	mesh.verts.resize((size_t)(side + 1) * (side + 1));
+	for (uint32 y = 0; y <= side; ++y) {
+		for (uint32 x = 0; x <= side; ++x) {
+			float fx = (float)x / side;
+			float fy = (float)y / side;
+			Vertex& v = mesh.verts[y * (side + 1) + x];
+			v.location = glm::vec3(fx, fy, 0.05f * std::sin(fx * 40.0f) * std::cos(fy * 30.0f));
+			v.texCoord = glm::vec2(fx, fy);
+		}
+	}
+	mesh.triangles.reserve((size_t)side * side * 6);
+	for (uint32 y = 0; y < side; ++y) {
+		for (uint32 x = 0; x < side; ++x) {
+			uint32 i = y * (side + 1) + x;
+			uint32 quad[6] = { i, i + 1, i + side + 1, i + 1, i + side + 2, i + side + 1 };
+			mesh.triangles.insert(mesh.triangles.end(), quad, quad + 6);
+		}
+	}
+
+	const char* names[] = { "area", "angle" };
+	for (int w = 0; w < 2; ++w) {
+		uint64_t start = SDL_GetPerformanceCounter();
+		computeNormals(mesh.verts, mesh.triangles, (NormalWeighting)w);
+		double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+		logDebug("computeNormals %s weighted: %d triangles, %d vertices in %.1f ms on %d threads",
+			names[w], (int)(mesh.triangles.size() / 3), (int)mesh.verts.size(), ms, (int)workerCount());
+	}
+
+	uint64_t start = SDL_GetPerformanceCounter();
+	computeTangents(mesh.verts, mesh.triangles);
+	double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+	logDebug("computeTangents: %d triangles, %d vertices in %.1f ms on %d threads",
+		(int)(mesh.triangles.size() / 3), (int)mesh.verts.size(), ms, (int)workerCount());
+}
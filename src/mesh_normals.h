@@ -0,0 +1,59 @@
+#ifndef MESH_NORMALS_H
+#define MESH_NORMALS_H
+
+#include "main.h"
+
+#include "glm/vec4.hpp"
+
+#include <vector>
+
+enum NormalWeighting
+{
+	// each face counts in proportion to its area, cheapest
+	NormalWeightingArea,
+	// each face counts by the angle of its corner at the vertex, which
+	// doesn't depend on how a surface happens to be triangulated
+	NormalWeightingAngle
+};
+
+/**
+ * @brief Computes smooth vertex normals from the faces around each vertex.
+ *
+ * Runs in a single pass over the triangles. With more than one thread each
+ * one sums a range of triangles into its own accumulator, which are added
+ * up per vertex range afterwards, so no atomics are needed. That costs an
+ * extra verts.size() * 12 bytes per additional thread.
+ * Triangles with out of range indices are skipped, vertices no triangle
+ * uses get a zero normal.
+ */
+void computeNormals(std::vector<Vertex>& verts, const std::vector<uint32>& triangles,
+	NormalWeighting weighting = NormalWeightingArea, uint32 maxThreads = 0);
+
+/**
+ * @brief Computes Vertex::tangent from the texture coordinates and normals,
+ * following MikkTSpace so normal maps baked by other tools line up.
+ *
+ * Each face's tangent is projected into the plane of the vertex normal and
+ * weighted by the corner angle, accumulated per thread like computeNormals.
+ * Where MikkTSpace would split a vertex shared by mirrored and unmirrored
+ * faces the side with the larger total angle is used instead. Vertices
+ * without a usable texture mapping get an arbitrary tangent perpendicular
+ * to their normal. The normals should be normalized.
+ */
+void computeTangents(std::vector<Vertex>& verts, const std::vector<uint32>& triangles, uint32 maxThreads = 0);
+
+/**
+ * @brief Packs a unit tangent and the bitangent sign into 10_10_10_2 signed
+ * normalized components, the bitangent is sign * cross(normal, tangent).
+ */
+uint32 packTangent(const glm::vec3& tangent, float sign);
+glm::vec4 unpackTangent(uint32 packed);
+
+/**
+ * @brief Times computeNormals on a generated grid of about triangleCount
+ * triangles in both weighting modes, and computeTangents, and logs the
+ * results.
+ */
+void benchmarkNormals(uint32 triangleCount);
+
+#endif // MESH_NORMALS_H
@@ -0,0 +1,211 @@
+#include "mesh_pipeline.h"
+#include "vertex_cache.h"
+#include "overdraw.h"
+#include "mesh_simplify.h"
+#include "meshlet.h"
+#include "vertex_quantize.h"
+#include "mesh_normals.h"
+#include "index_buffer.h"
+#include "mesh_bounds.h"
+#include "mesh_weld.h"
+#include "parallel.h"
+#include "sdl.h"
+
+#include <algorithm>
+
+static inline bool stepPending(const Mesh& mesh, uint32 step)
+{
+	return (mesh.stepsDone & step) == 0;
+}
+
+/**
+ * Steps are numbered in pipeline order and every step changes what the
+ * ones after it work on, so those have to run again.
+ */
+static inline void stepDone(Mesh& mesh, uint32 step)
+{
+	mesh.stepsDone = (mesh.stepsDone & (step - 1)) | step;
+}
+
+bool meshPipelinePending(const MeshPipeline& pipeline, const Mesh& mesh)
+{
+	return (pipeline.weldVertices && stepPending(mesh, meshStepWeld))
+		|| stepPending(mesh, meshStepSplit)
+		|| (!pipeline.lodRatios.empty() && stepPending(mesh, meshStepLods))
+		|| (pipeline.optimizeVertexCache && stepPending(mesh, meshStepVertexCache))
+		|| (pipeline.optimizeOverdraw && stepPending(mesh, meshStepOverdraw))
+		|| (pipeline.optimizeVertexFetch && stepPending(mesh, meshStepVertexFetch))
+		|| (pipeline.buildMeshlets && stepPending(mesh, meshStepMeshlets))
+		|| !mesh.hasBounds
+		|| (pipeline.generateTangents && !mesh.hasTangents)
+		|| (pipeline.quantizeVertices && stepPending(mesh, meshStepQuantize));
+}
+
+void weldMeshes(const MeshPipeline& pipeline, Mesh* meshes, uint32 count, uint32 maxThreads)
+{
+	if (!pipeline.weldVertices) {
+		return;
+	}
+	uint32 stepThreads = count > 1 ? 1 : maxThreads;
+	parallelFor(count, [&](uint32 i) {
+		Mesh& mesh = meshes[i];
+		if (!stepPending(mesh, meshStepWeld)) {
+			return;
+		}
+		uint64_t start = SDL_GetPerformanceCounter();
+		uint32 vertexCount = (uint32)mesh.verts.size();
+		shareVertices(mesh, true, pipeline.weldEpsilon, pipeline.weldNormalAngle, stepThreads);
+		stepDone(mesh, meshStepWeld);
+		double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+		logDebug("weld %s: %d -> %d vertices in %.1f ms", mesh.name.c_str(), vertexCount, (uint32)mesh.verts.size(), ms);
+	}, maxThreads);
+}
+
+void splitMeshes(const MeshPipeline& pipeline, std::vector<Mesh>& meshes, std::vector<bool>& firstParts)
+{
+	std::vector<Mesh> split;
+	firstParts.clear();
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		Mesh& mesh = meshes[i];
+		uint32 vertexCount = (uint32)mesh.verts.size();
+		if (vertexCount <= maxIndex16Vertices || vertexCount > pipeline.splitMaxVertices || !stepPending(mesh, meshStepSplit)) {
+			mesh.stepsDone |= meshStepSplit;
+			split.push_back(std::move(mesh));
+			firstParts.push_back(true);
+			continue;
+		}
+		size_t first = split.size();
+		splitMeshForIndex16(mesh, split);
+		for (size_t p = first; p < split.size(); ++p) {
+			stepDone(split[p], meshStepSplit);
+			firstParts.push_back(p == first);
+		}
+		logDebug("split %s with %d vertices into %d parts for 16 bit indices",
+			mesh.name.c_str(), vertexCount, (uint32)(split.size() - first));
+	}
+	meshes.swap(split);
+}
+
+void runMeshPipeline(const MeshPipeline& pipeline, Mesh& mesh, uint32 maxThreads)
+{
+	uint32 vertexCount = (uint32)mesh.verts.size();
+	uint32 cacheSize = pipeline.vertexCacheSize ? pipeline.vertexCacheSize : defaultVertexCacheSize;
+	// a mesh too small for lods counts as done too
+	if (!pipeline.lodRatios.empty() && stepPending(mesh, meshStepLods)) {
+		if (mesh.triangles.size() / 3 >= pipeline.lodMinTriangles) {
+			uint64_t start = SDL_GetPerformanceCounter();
+			generateLods(mesh, pipeline.lodRatios);
+			double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+			for (size_t i = 0; i < mesh.lods.size(); ++i) {
+				logDebug("lod %d of %s: %d triangles, error %g", (uint32)i + 1, mesh.name.c_str(),
+					mesh.lods[i].indexCount / 3, mesh.lods[i].error);
+			}
+			logDebug("simplified %s in %.1f ms", mesh.name.c_str(), ms);
+		}
+		stepDone(mesh, meshStepLods);
+	}
+	if (pipeline.optimizeVertexCache && stepPending(mesh, meshStepVertexCache)) {
+		uint64_t start = SDL_GetPerformanceCounter();
+		VertexCacheStats before = analyzeVertexCache(mesh.triangles, vertexCount, cacheSize);
+		optimizeVertexCache(mesh.triangles, vertexCount, cacheSize);
+		VertexCacheStats after = analyzeVertexCache(mesh.triangles, vertexCount, cacheSize);
+		std::vector<uint32> lodTriangles;
+		for (size_t i = 0; i < mesh.lods.size(); ++i) {
+			std::vector<uint32>::iterator first = mesh.lodTriangles.begin() + mesh.lods[i].firstIndex;
+			lodTriangles.assign(first, first + mesh.lods[i].indexCount);
+			optimizeVertexCache(lodTriangles, vertexCount, cacheSize);
+			std::copy(lodTriangles.begin(), lodTriangles.end(), first);
+		}
+		double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+		logDebug("vertex cache %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f in %.1f ms",
+			mesh.name.c_str(), before.acmr, after.acmr, before.atvr, after.atvr, ms);
+		stepDone(mesh, meshStepVertexCache);
+	}
+	if (pipeline.optimizeOverdraw && stepPending(mesh, meshStepOverdraw)) {
+		float threshold = pipeline.overdrawThreshold >= 1.0f ? pipeline.overdrawThreshold : 1.0f;
+		OverdrawStats before = {};
+		if (pipeline.reportOverdraw) {
+			before = analyzeOverdraw(mesh.triangles, mesh.verts);
+		}
+		uint64_t start = SDL_GetPerformanceCounter();
+		optimizeOverdraw(mesh.triangles, mesh.verts, threshold, cacheSize);
+		double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+		if (pipeline.reportOverdraw) {
+			OverdrawStats after = analyzeOverdraw(mesh.triangles, mesh.verts);
+			VertexCacheStats cache = analyzeVertexCache(mesh.triangles, vertexCount, cacheSize);
+			logDebug("overdraw %s: %.3f -> %.3f, ACMR %.3f in %.1f ms",
+				mesh.name.c_str(), before.overdraw, after.overdraw, cache.acmr, ms);
+		}
+		else {
+			logDebug("overdraw %s: optimized in %.1f ms", mesh.name.c_str(), ms);
+		}
+		stepDone(mesh, meshStepOverdraw);
+	}
+	if (pipeline.optimizeVertexFetch && stepPending(mesh, meshStepVertexFetch)) {
+		uint64_t start = SDL_GetPerformanceCounter();
+		uint32 dropped = optimizeVertexFetch(mesh.triangles, mesh.verts, &mesh.lodTriangles);
+		double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+		logDebug("vertex fetch %s: %d vertices, %d unused dropped in %.1f ms",
+			mesh.name.c_str(), (uint32)mesh.verts.size(), dropped, ms);
+		stepDone(mesh, meshStepVertexFetch);
+	}
+	if (pipeline.buildMeshlets && stepPending(mesh, meshStepMeshlets)) {
+		uint64_t start = SDL_GetPerformanceCounter();
+		buildMeshlets(mesh, pipeline.meshletVertices ? pipeline.meshletVertices : defaultMeshletVertices,
+			pipeline.meshletTriangles ? pipeline.meshletTriangles : defaultMeshletTriangles);
+		double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+		logDebug("meshlets %s: %d meshlets in %.1f ms", mesh.name.c_str(), (uint32)mesh.meshlets.size(), ms);
+		stepDone(mesh, meshStepMeshlets);
+	}
+	// meshes from the mesh cache already have theirs, quantized vertices
+	// made without them are out of date
+	if (pipeline.generateTangents && !mesh.hasTangents) {
+		uint64_t start = SDL_GetPerformanceCounter();
+		computeTangents(mesh.verts, mesh.triangles, maxThreads);
+		mesh.hasTangents = true;
+		mesh.stepsDone &= ~meshStepQuantize;
+		double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+		logDebug("tangents %s: %d vertices in %.1f ms", mesh.name.c_str(), (uint32)mesh.verts.size(), ms);
+	}
+	// the remaining kernels read the vertices, positions and normals don't
+	// change from here on so they share one copy in streams
+	bool quantize = pipeline.quantizeVertices && stepPending(mesh, meshStepQuantize);
+	VertexStreams streams = {};
+	if (!mesh.hasBounds || quantize) {
+		uint64_t start = SDL_GetPerformanceCounter();
+		buildVertexStreams(streams, mesh.verts.data(), mesh.verts.size());
+		double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+		logDebug("vertex streams %s: %d vertices in %.1f ms%s", mesh.name.c_str(), (uint32)mesh.verts.size(), ms,
+			useAvx2() ? ", using avx2" : "");
+	}
+	// after the vertex fetch step, which may drop vertices
+	if (!mesh.hasBounds) {
+		uint64_t start = SDL_GetPerformanceCounter();
+		computeBounds(streams, mesh.bounds);
+		mesh.hasBounds = true;
+		double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+		logDebug("bounds %s: radius %g in %.1f ms", mesh.name.c_str(), mesh.bounds.radius, ms);
+	}
+	if (quantize) {
+		uint64_t start = SDL_GetPerformanceCounter();
+		QuantizationStats stats;
+		quantizeVertices(mesh, streams, &stats);
+		double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+		logDebug("quantized %s: %d -> %d bytes per vertex, position error %g (bound %g), normal error %.4f degrees in %.1f ms",
+			mesh.name.c_str(), (uint32)sizeof(Vertex),
+			(uint32)(sizeof(QuantizedVertex) + (mesh.quantizedTangentSpace.empty() ? 0 : sizeof(QuantizedTangentSpace))),
+			stats.positionError, stats.positionErrorBound, stats.normalErrorDegrees, ms);
+		stepDone(mesh, meshStepQuantize);
+	}
+	freeVertexStreams(streams);
+}
+
+void runMeshPipeline(const MeshPipeline& pipeline, Mesh* meshes, uint32 count, uint32 maxThreads)
+{
+	// threads within threads would run up to cores squared of them, each
+	// with its own per vertex buffers
+	uint32 stepThreads = count > 1 ? 1 : maxThreads;
+	parallelFor(count, [&](uint32 i) {
+		runMeshPipeline(pipeline, meshes[i], stepThreads);
+	}, maxThreads);
+}
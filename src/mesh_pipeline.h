@@ -0,0 +1,102 @@
+#ifndef MESH_PIPELINE_H
+#define MESH_PIPELINE_H
+
+#include "main.h"
+
+#include <vector>
+
+// Mesh::stepsDone bits, a step that is done is skipped by the pipeline,
+// so meshes from the mesh cache only go through the steps that weren't
+// enabled when they were cached
+const uint32 meshStepWeld = 1 << 0;
+const uint32 meshStepSplit = 1 << 1;
+const uint32 meshStepLods = 1 << 2;
+const uint32 meshStepVertexCache = 1 << 3;
+const uint32 meshStepOverdraw = 1 << 4;
+const uint32 meshStepVertexFetch = 1 << 5;
+const uint32 meshStepMeshlets = 1 << 6;
+const uint32 meshStepQuantize = 1 << 7;
+
+/**
+ * @brief Processing steps applied to every mesh once it is loaded, no
+ * matter which loader it came from or whether it was read from the mesh
+ * cache, before it is handed to the renderer. Mesh::bounds is always
+ * filled in.
+ */
+struct MeshPipeline
+{
+	// first merge duplicate vertices, those within weldEpsilon of each
+	// other (0 only merges exact duplicates) with normals at most
+	// weldNormalAngle degrees apart and the same texture coordinates
+	bool weldVertices;
+	float weldEpsilon;
+	float weldNormalAngle;
+	// then meshes with more than maxIndex16Vertices but at most this many
+	// vertices are split into parts that fit 16 bit indices, 0 never splits
+	uint32 splitMaxVertices;
+
+	// reorder triangles for the post-transform vertex cache
+	bool optimizeVertexCache;
+	// 0 uses defaultVertexCacheSize
+	uint32 vertexCacheSize;
+	// then sort clusters of those triangles to reduce overdraw, letting
+	// ACMR get up to overdrawThreshold times worse (e.g. 1.05)
+	bool optimizeOverdraw;
+	float overdrawThreshold;
+	// log the overdraw and ACMR it ends up with, which rasterizes the mesh
+	// from six directions before and after, only worth it when tuning
+	bool reportOverdraw;
+	// finally renumber vertices in first use order and drop unused ones
+	bool optimizeVertexFetch;
+	// before any of that build a lod for each fraction of the triangles,
+	// for meshes with at least lodMinTriangles that don't have lods yet
+	std::vector<float> lodRatios;
+	uint32 lodMinTriangles;
+	// last split the final triangle order into meshlets for culling, 0
+	// limits use defaultMeshletVertices and defaultMeshletTriangles
+	bool buildMeshlets;
+	uint32 meshletVertices;
+	uint32 meshletTriangles;
+	// compute Vertex::tangent for meshes that don't have tangents yet
+	bool generateTangents;
+	// and fill Mesh::quantizedVerts so the gpu gets 12 byte vertices, plus
+	// 8 bytes of Mesh::quantizedTangentSpace for textured meshes
+	bool quantizeVertices;
+};
+
+/**
+ * @brief Whether any step of the pipeline would still change the mesh,
+ * meshes from the mesh cache that were cached with the same pipeline
+ * don't need their vertices and indices copied out of the cache.
+ */
+bool meshPipelinePending(const MeshPipeline& pipeline, const Mesh& mesh);
+
+/**
+ * @brief Welds the vertices of count meshes, one mesh per thread on up to
+ * maxThreads threads (0 uses one per core). Runs before splitMeshes since
+ * welding can bring a mesh under the 16 bit index limit.
+ */
+void weldMeshes(const MeshPipeline& pipeline, Mesh* meshes, uint32 count, uint32 maxThreads = 0);
+
+/**
+ * @brief Replaces the meshes the pipeline wants split by their parts, in
+ * place. Runs before runMeshPipeline since the parts get their own lods.
+ * firstParts says for every resulting mesh whether it's the first or only
+ * part of its mesh.
+ */
+void splitMeshes(const MeshPipeline& pipeline, std::vector<Mesh>& meshes, std::vector<bool>& firstParts);
+
+/**
+ * @brief Runs the pipeline on one mesh, the steps that are threaded
+ * themselves use up to maxThreads threads (0 uses one per core).
+ */
+void runMeshPipeline(const MeshPipeline& pipeline, Mesh& mesh, uint32 maxThreads = 0);
+
+/**
+ * @brief Runs the pipeline on count meshes, one mesh per thread on up to
+ * maxThreads threads (0 uses one per core). The steps only get threads of
+ * their own when there is a single mesh.
+ */
+void runMeshPipeline(const MeshPipeline& pipeline, Mesh* meshes, uint32 count, uint32 maxThreads = 0);
+
+#endif // MESH_PIPELINE_H
@@ -0,0 +1,481 @@
+#include "mesh_simplify.h"
+
+#include "glm/geometric.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// border planes are weighted well above the faces so borders keep their
+// shape rather than just their plane
+const float borderWeight = 10.0f;
+
+/**
+ * Sum of squared distances to a set of weighted planes, the symmetric 4x4
+ * matrix of Garland and Heckbert stored as its 10 unique terms plus the
+ * total weight, so the error can be reported as a mean distance.
+ */
+struct Quadric
+{
+	double a2, b2, c2, d2, ab, ac, ad, bc, bd, cd;
+	double weight;
+};
+
+void addPlane(Quadric& q, const glm::vec3& n, float d, float weight)
+{
+	double a = n.x, b = n.y, c = n.z;
+	q.a2 += a * a * weight;
+	q.b2 += b * b * weight;
+	q.c2 += c * c * weight;
+	q.d2 += (double)d * d * weight;
+	q.ab += a * b * weight;
+	q.ac += a * c * weight;
+	q.ad += a * d * weight;
+	q.bc += b * c * weight;
+	q.bd += b * d * weight;
+	q.cd += c * d * weight;
+	q.weight += weight;
+}
+
+void addQuadric(Quadric& q, const Quadric& other)
+{
+	q.a2 += other.a2;
+	q.b2 += other.b2;
+	q.c2 += other.c2;
+	q.d2 += other.d2;
+	q.ab += other.ab;
+	q.ac += other.ac;
+	q.ad += other.ad;
+	q.bc += other.bc;
+	q.bd += other.bd;
+	q.cd += other.cd;
+	q.weight += other.weight;
+}
+
+// mean squared distance of p to the planes of both quadrics
+float collapseError(const Quadric& q, const Quadric& other, const glm::vec3& p)
+{
+	Quadric sum = q;
+	addQuadric(sum, other);
+	double x = p.x, y = p.y, z = p.z;
+	double error = x * x * sum.a2 + y * y * sum.b2 + z * z * sum.c2
+		+ 2.0 * (x * y * sum.ab + x * z * sum.ac + y * z * sum.bc)
+		+ 2.0 * (x * sum.ad + y * sum.bd + z * sum.cd)
+		+ sum.d2;
+	return sum.weight > 0.0 ? (float)(std::max(error, 0.0) / sum.weight) : 0.0f;
+}
+
+enum VertexKind : uint8_t
+{
+	VertexKindManifold,
+	// on an open border, only moves along it
+	VertexKindBorder,
+	// one of two vertices sharing a position, moves along the seam with its twin
+	VertexKindSeam,
+	VertexKindLocked,
+};
+
+/**
+ * Vertices at the same position form a class named after its lowest
+ * vertex, all topology (adjacency, borders, quadrics) is per class so
+ * normal seams don't look like holes.
+ */
+struct SimplifyState
+{
+	const std::vector<Vertex>* verts;
+	std::vector<uint32> classOf;
+	std::vector<uint32> twin;
+	std::vector<uint8_t> classSize;
+	std::vector<uint8_t> kind;
+	std::vector<Quadric> quadrics;
+
+	// current triangles and the triangles around each class
+	std::vector<uint32> triangles;
+	std::vector<uint32> adjacencyStarts;
+	std::vector<uint32> adjacency;
+};
+
+struct Collapse
+{
+	uint32 from;
+	uint32 to;
+	float error;
+};
+
+inline const glm::vec3& position(const SimplifyState& state, uint32 v)
+{
+	return (*state.verts)[v].location;
+}
+
+inline uint32 floatBits(float f)
+{
+	// +0 and -0 are the same position
+	if (f == 0.0f) {
+		return 0;
+	}
+	uint32 bits;
+	memcpy(&bits, &f, sizeof(bits));
+	return bits;
+}
+
+void buildClasses(SimplifyState& state)
+{
+	const std::vector<Vertex>& verts = *state.verts;
+	uint32 vertexCount = (uint32)verts.size();
+	std::vector<uint32> order(vertexCount);
+	for (uint32 v = 0; v < vertexCount; ++v) {
+		order[v] = v;
+	}
+	std::sort(order.begin(), order.end(), [&](uint32 a, uint32 b) {
+		for (int i = 0; i < 3; ++i) {
+			uint32 ba = floatBits(verts[a].location[i]);
+			uint32 bb = floatBits(verts[b].location[i]);
+			if (ba != bb) {
+				return ba < bb;
+			}
+		}
+		return a < b;
+	});
+
+	state.classOf.resize(vertexCount);
+	state.twin.resize(vertexCount);
+	state.classSize.assign(vertexCount, 0);
+	for (uint32 first = 0; first < vertexCount;) {
+		uint32 last = first + 1;
+		while (last < vertexCount
+			&& floatBits(verts[order[last]].location.x) == floatBits(verts[order[first]].location.x)
+			&& floatBits(verts[order[last]].location.y) == floatBits(verts[order[first]].location.y)
+			&& floatBits(verts[order[last]].location.z) == floatBits(verts[order[first]].location.z)) {
+			++last;
+		}
+		uint32 rep = order[first];
+		for (uint32 i = first; i < last; ++i) {
+			state.classOf[order[i]] = rep;
+			state.twin[order[i]] = last - first == 2 ? order[first + last - 1 - i] : order[i];
+		}
+		state.classSize[rep] = (uint8_t)std::min(last - first, 255u);
+		first = last;
+	}
+}
+
+void buildAdjacency(SimplifyState& state)
+{
+	uint32 vertexCount = (uint32)state.classOf.size();
+	state.adjacencyStarts.assign(vertexCount + 1, 0);
+	for (size_t i = 0; i < state.triangles.size(); ++i) {
+		state.adjacencyStarts[state.classOf[state.triangles[i]] + 1]++;
+	}
+	for (uint32 c = 0; c < vertexCount; ++c) {
+		state.adjacencyStarts[c + 1] += state.adjacencyStarts[c];
+	}
+	state.adjacency.resize(state.triangles.size());
+	std::vector<uint32> next(state.adjacencyStarts.begin(), state.adjacencyStarts.end() - 1);
+	for (size_t i = 0; i < state.triangles.size(); ++i) {
+		state.adjacency[next[state.classOf[state.triangles[i]]]++] = (uint32)(i / 3);
+	}
+}
+
+bool triangleHasClass(const SimplifyState& state, uint32 t, uint32 c)
+{
+	const uint32* tri = &state.triangles[t * 3];
+	return state.classOf[tri[0]] == c || state.classOf[tri[1]] == c || state.classOf[tri[2]] == c;
+}
+
+uint32 edgeCount(const SimplifyState& state, uint32 ca, uint32 cb)
+{
+	uint32 count = 0;
+	for (uint32 a = state.adjacencyStarts[ca]; a < state.adjacencyStarts[ca + 1]; ++a) {
+		count += triangleHasClass(state, state.adjacency[a], cb);
+	}
+	return count;
+}
+
+bool hasVertexEdge(const SimplifyState& state, uint32 a, uint32 b)
+{
+	uint32 ca = state.classOf[a];
+	for (uint32 i = state.adjacencyStarts[ca]; i < state.adjacencyStarts[ca + 1]; ++i) {
+		const uint32* tri = &state.triangles[state.adjacency[i] * 3];
+		bool hasA = tri[0] == a || tri[1] == a || tri[2] == a;
+		bool hasB = tri[0] == b || tri[1] == b || tri[2] == b;
+		if (hasA && hasB) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void classifyVertices(SimplifyState& state)
+{
+	uint32 vertexCount = (uint32)state.classOf.size();
+	std::vector<uint8_t> border(vertexCount, 0);
+	std::vector<uint8_t> locked(vertexCount, 0);
+	state.quadrics.assign(vertexCount, Quadric());
+
+	for (size_t t = 0; t * 3 < state.triangles.size(); ++t) {
+		const uint32* tri = &state.triangles[t * 3];
+		const glm::vec3& p0 = position(state, tri[0]);
+		glm::vec3 normal = glm::cross(position(state, tri[1]) - p0, position(state, tri[2]) - p0);
+		float length = glm::length(normal);
+		if (length > 0.0f) {
+			glm::vec3 n = normal / length;
+			Quadric face = {};
+			addPlane(face, n, -glm::dot(n, p0), length * 0.5f);
+			for (int k = 0; k < 3; ++k) {
+				addQuadric(state.quadrics[state.classOf[tri[k]]], face);
+			}
+		}
+
+		for (int k = 0; k < 3; ++k) {
+			uint32 a = tri[k];
+			uint32 b = tri[(k + 1) % 3];
+			uint32 ca = state.classOf[a];
+			uint32 cb = state.classOf[b];
+			uint32 count = edgeCount(state, ca, cb);
+			if (count > 2) {
+				locked[ca] = locked[cb] = 1;
+			}
+			if (count != 1) {
+				continue;
+			}
+			border[ca] = border[cb] = 1;
+			// a plane through the edge at right angles to the face holds
+			// the border in place
+			glm::vec3 edge = position(state, b) - position(state, a);
+			glm::vec3 n = glm::cross(edge, normal);
+			float nLength = glm::length(n);
+			if (nLength > 0.0f) {
+				n /= nLength;
+				Quadric plane = {};
+				addPlane(plane, n, -glm::dot(n, position(state, a)), glm::dot(edge, edge) * borderWeight);
+				addQuadric(state.quadrics[ca], plane);
+				addQuadric(state.quadrics[cb], plane);
+			}
+		}
+	}
+
+	state.kind.assign(vertexCount, VertexKindLocked);
+	for (uint32 c = 0; c < vertexCount; ++c) {
+		uint32 size = state.classSize[c];
+		if (size == 0 || size > 2 || locked[c] || (border[c] && size == 2)) {
+			continue;
+		}
+		state.kind[c] = border[c] ? VertexKindBorder : size == 2 ? VertexKindSeam : VertexKindManifold;
+	}
+}
+
+bool canCollapse(const SimplifyState& state, uint32 from, uint32 to)
+{
+	uint32 cf = state.classOf[from];
+	uint32 ct = state.classOf[to];
+	switch (state.kind[cf]) {
+	case VertexKindManifold:
+		return true;
+	case VertexKindBorder:
+		return edgeCount(state, cf, ct) == 1;
+	case VertexKindSeam:
+		// the twins have to be joined by an edge on the other side too
+		return state.classSize[ct] == 2
+			&& edgeCount(state, cf, ct) == 2
+			&& hasVertexEdge(state, state.twin[from], state.twin[to]);
+	default:
+		return false;
+	}
+}
+
+/**
+ * Rejects collapses that would turn any of the remaining triangles around
+ * from over, or come close to it.
+ */
+bool flipsTriangles(const SimplifyState& state, uint32 from, uint32 to)
+{
+	uint32 cf = state.classOf[from];
+	uint32 ct = state.classOf[to];
+	const glm::vec3& target = position(state, to);
+	for (uint32 a = state.adjacencyStarts[cf]; a < state.adjacencyStarts[cf + 1]; ++a) {
+		uint32 t = state.adjacency[a];
+		if (triangleHasClass(state, t, ct)) {
+			continue;
+		}
+		glm::vec3 before[3];
+		glm::vec3 after[3];
+		for (int k = 0; k < 3; ++k) {
+			uint32 v = state.triangles[t * 3 + k];
+			before[k] = position(state, v);
+			after[k] = state.classOf[v] == cf ? target : before[k];
+		}
+		glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+		glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+		if (glm::dot(n0, n1) <= 0.25f * glm::length(n0) * glm::length(n1)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * One round of collapses, the cheapest first, none of them touching
+ * triangles another collapse in the same round changed.
+ * @return the number of collapses done
+ */
+uint32 simplifyPass(SimplifyState& state, uint32 targetCount, float& maxError)
+{
+	uint32 triCount = (uint32)(state.triangles.size() / 3);
+	buildAdjacency(state);
+
+	// each interior edge shows up in two triangles with opposite winding,
+	// only the one with the lower first vertex is needed
+	std::vector<Collapse> collapses;
+	collapses.reserve(triCount * 3 / 2);
+	for (uint32 t = 0; t < triCount; ++t) {
+		for (int k = 0; k < 3; ++k) {
+			uint32 a = state.triangles[t * 3 + k];
+			uint32 b = state.triangles[t * 3 + (k + 1) % 3];
+			uint32 ca = state.classOf[a];
+			uint32 cb = state.classOf[b];
+			if (a > b && state.kind[ca] == VertexKindManifold && state.kind[cb] == VertexKindManifold) {
+				continue;
+			}
+			// try collapsing either way and keep the cheaper one
+			Collapse best = { 0, 0, -1.0f };
+			if (canCollapse(state, a, b)) {
+				Collapse c = { a, b, collapseError(state.quadrics[ca], state.quadrics[cb], position(state, b)) };
+				best = c;
+			}
+			if (canCollapse(state, b, a)) {
+				float error = collapseError(state.quadrics[cb], state.quadrics[ca], position(state, a));
+				if (best.error < 0.0f || error < best.error) {
+					Collapse c = { b, a, error };
+					best = c;
+				}
+			}
+			if (best.error >= 0.0f) {
+				collapses.push_back(best);
+			}
+		}
+	}
+	if (collapses.empty()) {
+		return 0;
+	}
+	std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+		return a.error < b.error;
+	});
+
+	// a collapse removes about two triangles, don't go much past the
+	// error of the ones needed to hit the target so the expensive ones
+	// wait for a later round where something cheaper may have turned up
+	uint32 wanted = std::max((triCount - targetCount) / 2, 1u);
+	float errorLimit = collapses[std::min(wanted, (uint32)collapses.size()) - 1].error * 1.5f;
+
+	uint32 vertexCount = (uint32)state.classOf.size();
+	std::vector<uint8_t> locked(vertexCount, 0);
+	std::vector<uint32> collapseTo(vertexCount);
+	for (uint32 v = 0; v < vertexCount; ++v) {
+		collapseTo[v] = v;
+	}
+	uint32 done = 0;
+	uint32 removed = 0;
+	for (size_t i = 0; i < collapses.size() && removed < triCount - targetCount; ++i) {
+		const Collapse& c = collapses[i];
+		if (c.error > errorLimit) {
+			break;
+		}
+		uint32 cf = state.classOf[c.from];
+		uint32 ct = state.classOf[c.to];
+		if (locked[cf] || locked[ct] || flipsTriangles(state, c.from, c.to)) {
+			continue;
+		}
+		for (uint32 a = state.adjacencyStarts[cf]; a < state.adjacencyStarts[cf + 1]; ++a) {
+			const uint32* tri = &state.triangles[state.adjacency[a] * 3];
+			for (int k = 0; k < 3; ++k) {
+				locked[state.classOf[tri[k]]] = 1;
+			}
+		}
+		collapseTo[c.from] = c.to;
+		if (state.kind[cf] == VertexKindSeam) {
+			collapseTo[state.twin[c.from]] = state.twin[c.to];
+		}
+		addQuadric(state.quadrics[ct], state.quadrics[cf]);
+		maxError = std::max(maxError, c.error);
+		removed += state.kind[cf] == VertexKindBorder ? 1 : 2;
+		done++;
+	}
+
+	// collapse targets are locked, so one step of collapseTo is enough
+	uint32 kept = 0;
+	for (uint32 t = 0; t < triCount; ++t) {
+		uint32 tri[3];
+		for (int k = 0; k < 3; ++k) {
+			tri[k] = collapseTo[state.triangles[t * 3 + k]];
+		}
+		uint32 c0 = state.classOf[tri[0]];
+		uint32 c1 = state.classOf[tri[1]];
+		uint32 c2 = state.classOf[tri[2]];
+		if (c0 == c1 || c1 == c2 || c0 == c2) {
+			continue;
+		}
+		memcpy(&state.triangles[kept * 3], tri, sizeof(tri));
+		kept++;
+	}
+	state.triangles.resize(kept * 3);
+	return done;
+}
+
+} // namespace
+
+void generateLods(Mesh& mesh, const std::vector<float>& ratios)
+{
+	mesh.lodTriangles.clear();
+	mesh.lods.clear();
+
+	SimplifyState state;
+	state.verts = &mesh.verts;
+	buildClasses(state);
+
+	// simplify a copy without triangles that are already degenerate or
+	// reference missing vertices
+	uint32 vertexCount = (uint32)mesh.verts.size();
+	state.triangles.reserve(mesh.triangles.size());
+	for (size_t i = 0; i + 2 < mesh.triangles.size(); i += 3) {
+		const uint32* tri = &mesh.triangles[i];
+		if (tri[0] >= vertexCount || tri[1] >= vertexCount || tri[2] >= vertexCount) {
+			continue;
+		}
+		uint32 c0 = state.classOf[tri[0]];
+		uint32 c1 = state.classOf[tri[1]];
+		uint32 c2 = state.classOf[tri[2]];
+		if (c0 != c1 && c1 != c2 && c0 != c2) {
+			state.triangles.insert(state.triangles.end(), tri, tri + 3);
+		}
+	}
+	uint32 fullCount = (uint32)(state.triangles.size() / 3);
+	if (fullCount == 0) {
+		return;
+	}
+	buildAdjacency(state);
+	classifyVertices(state);
+
+	// each lod carries on from the one before, so the quadrics keep the
+	// error of everything collapsed so far
+	float maxError = 0.0f;
+	uint32 previousCount = fullCount;
+	for (size_t i = 0; i < ratios.size(); ++i) {
+		uint32 targetCount = (uint32)(fullCount * std::max(ratios[i], 0.0f));
+		bool stuck = false;
+		while (state.triangles.size() / 3 > targetCount && !stuck) {
+			stuck = simplifyPass(state, targetCount, maxError) == 0;
+		}
+		uint32 count = (uint32)(state.triangles.size() / 3);
+		if (count >= previousCount || count == 0) {
+			break;
+		}
+		MeshLod lod = { (uint32)mesh.lodTriangles.size(), count * 3, std::sqrt(maxError) };
+		mesh.lodTriangles.insert(mesh.lodTriangles.end(), state.triangles.begin(), state.triangles.end());
+		mesh.lods.push_back(lod);
+		previousCount = count;
+		if (stuck) {
+			break;
+		}
+	}
+}
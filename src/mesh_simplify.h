@@ -0,0 +1,21 @@
+#ifndef MESH_SIMPLIFY_H
+#define MESH_SIMPLIFY_H
+
+#include "main.h"
+
+#include <vector>
+
+/**
+ * @brief Builds mesh.lods by simplifying mesh.triangles with quadric error
+ * edge collapses (Garland and Heckbert 1997), one lod per entry of ratios,
+ * each the fraction of the full triangle count to aim for (e.g. 0.5, 0.25).
+ *
+ * Collapses only move a vertex onto a neighbour, so every lod uses a subset
+ * of mesh.verts. Vertices on open borders only slide along the border and
+ * vertices split by a normal seam only collapse along the seam together
+ * with their twin, anything more complicated stays where it is. The chain
+ * stops early when the mesh can't be simplified any further.
+ */
+void generateLods(Mesh& mesh, const std::vector<float>& ratios);
+
+#endif // MESH_SIMPLIFY_H
@@ -0,0 +1,230 @@
+#include "mesh_weld.h"
+#include "parallel.h"
+
+#include "glm/geometric.hpp"
+#include "glm/trigonometric.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// vertices per parallel task, small enough to balance, big enough to matter
+const uint32 verticesPerTask = 1 << 14;
+
+inline uint32 hashCell(int32 x, int32 y, int32 z)
+{
+	uint32 h = (uint32)x * 0x8DA6B343u ^ (uint32)y * 0xD8163841u ^ (uint32)z * 0xCB1AB31Fu;
+	h ^= h >> 16;
+	h *= 0x7FEB352Du;
+	h ^= h >> 15;
+	return h;
+}
+
+inline uint32 floatBits(float f)
+{
+	// +0 and -0 are the same position
+	if (f == 0.0f) {
+		return 0;
+	}
+	uint32 bits;
+	memcpy(&bits, &f, sizeof(bits));
+	return bits;
+}
+
+// vertices only weld when these match exactly, so they're part of the key
+inline uint32 hashAttributes(const Vertex& vertex, bool withTangent)
+{
+	uint32 h = floatBits(vertex.texCoord.x) * 0x9E3779B1u ^ floatBits(vertex.texCoord.y) * 0x85EBCA77u;
+	if (withTangent) {
+		h ^= vertex.tangent * 0xC2B2AE3Du;
+	}
+	return h;
+}
+
+inline bool sameAttributes(const Vertex& a, const Vertex& b, bool withTangent)
+{
+	return a.texCoord == b.texCoord && (!withTangent || a.tangent == b.tangent);
+}
+
+/**
+ * A hash grid flattened into buckets, every vertex is filed under the hash
+ * of its cell and its attributes. Different keys can share a bucket, so
+ * lookups still check the actual distance and attributes. Vertices within
+ * a bucket are in index order.
+ */
+struct WeldGrid
+{
+	float cellSize;
+	bool withTangent;
+	uint32 mask;
+	std::vector<uint32> bucketStarts;
+	std::vector<uint32> vertices;
+};
+
+inline void cellOf(const WeldGrid& grid, const glm::vec3& p, int32 cell[3])
+{
+	if (grid.cellSize > 0.0f) {
+		// far away cells can share a clamped coordinate, that's only slower
+		for (int i = 0; i < 3; ++i) {
+			float c = std::floor(p[i] / grid.cellSize);
+			cell[i] = (int32)std::max(-1e9f, std::min(c, 1e9f));
+		}
+	}
+	else {
+		// exact welding, the cell is the position itself
+		for (int i = 0; i < 3; ++i) {
+			cell[i] = (int32)floatBits(p[i]);
+		}
+	}
+}
+
+inline uint32 bucketOf(const WeldGrid& grid, const int32 cell[3], uint32 attributes)
+{
+	return (hashCell(cell[0], cell[1], cell[2]) ^ attributes) & grid.mask;
+}
+
+void buildGrid(WeldGrid& grid, const std::vector<Vertex>& verts, float epsilon, bool withTangent, uint32 threadCount)
+{
+	uint32 vertCount = (uint32)verts.size();
+	uint32 bucketCount = 16;
+	while (bucketCount < vertCount) {
+		bucketCount *= 2;
+	}
+	grid.cellSize = epsilon;
+	grid.withTangent = withTangent;
+	grid.mask = bucketCount - 1;
+
+	std::vector<uint32> buckets(vertCount);
+	parallelFor((vertCount + verticesPerTask - 1) / verticesPerTask, [&](uint32 task) {
+		uint32 last = std::min(vertCount, (task + 1) * verticesPerTask);
+		for (uint32 v = task * verticesPerTask; v < last; ++v) {
+			int32 cell[3];
+			cellOf(grid, verts[v].location, cell);
+			buckets[v] = bucketOf(grid, cell, hashAttributes(verts[v], withTangent));
+		}
+	}, threadCount);
+
+	// counting sort by bucket, stable so each bucket stays in index order
+	grid.bucketStarts.assign(bucketCount + 1, 0);
+	for (uint32 v = 0; v < vertCount; ++v) {
+		grid.bucketStarts[buckets[v] + 1]++;
+	}
+	for (uint32 b = 0; b < bucketCount; ++b) {
+		grid.bucketStarts[b + 1] += grid.bucketStarts[b];
+	}
+	std::vector<uint32> next(grid.bucketStarts.begin(), grid.bucketStarts.end() - 1);
+	grid.vertices.resize(vertCount);
+	for (uint32 v = 0; v < vertCount; ++v) {
+		grid.vertices[next[buckets[v]]++] = v;
+	}
+}
+
+} // namespace
+
+void shareVertices(Mesh& mesh, bool shareVerts, float epsilon, float maxNormalAngle, uint32 maxThreads)
+{
+	if (!shareVerts) {
+		bool vertsAreShared = mesh.verts.size() != mesh.triangles.size();
+		if (vertsAreShared) {
+			std::vector<Vertex> verts(mesh.triangles.size());
+			for (size_t i = 0; i < mesh.triangles.size(); ++i) {
+				verts[i] = mesh.verts[mesh.triangles[i]];
+				mesh.triangles[i] = (uint32)i;
+			}
+			mesh.verts = std::move(verts);
+			logDebug("mesh converted to unshared vertices");
+		}
+		return;
+	}
+
+	uint32 vertCount = (uint32)mesh.verts.size();
+	uint32 threadCount = maxThreads ? maxThreads : workerCount();
+	const std::vector<Vertex>& verts = mesh.verts;
+	WeldGrid grid;
+	buildGrid(grid, verts, epsilon, mesh.hasTangents, threadCount);
+
+	bool checkNormals = maxNormalAngle < 180.0f;
+	float minNormalDot = std::cos(glm::radians(maxNormalAngle));
+	float epsilonSquared = epsilon * epsilon;
+	int32 reach = epsilon > 0.0f ? 1 : 0;
+
+	// every vertex picks the lowest numbered vertex it may weld to, searching
+	// the cells around it only reads the grid so vertices run in parallel
+	std::vector<uint32> remap(vertCount);
+	parallelFor((vertCount + verticesPerTask - 1) / verticesPerTask, [&](uint32 task) {
+		uint32 last = std::min(vertCount, (task + 1) * verticesPerTask);
+		for (uint32 v = task * verticesPerTask; v < last; ++v) {
+			const Vertex& vertex = verts[v];
+			int32 cell[3];
+			cellOf(grid, vertex.location, cell);
+			uint32 attributes = hashAttributes(vertex, grid.withTangent);
+			uint32 best = v;
+			for (int32 dz = -reach; dz <= reach; ++dz) {
+				for (int32 dy = -reach; dy <= reach; ++dy) {
+					for (int32 dx = -reach; dx <= reach; ++dx) {
+						int32 around[3] = { cell[0] + dx, cell[1] + dy, cell[2] + dz };
+						uint32 b = bucketOf(grid, around, attributes);
+						for (uint32 i = grid.bucketStarts[b]; i < grid.bucketStarts[b + 1]; ++i) {
+							uint32 other = grid.vertices[i];
+							if (other >= best) {
+								break;
+							}
+							const Vertex& candidate = verts[other];
+							glm::vec3 d = candidate.location - vertex.location;
+							bool close = epsilon > 0.0f
+								? glm::dot(d, d) <= epsilonSquared
+								: candidate.location == vertex.location;
+							if (close && sameAttributes(candidate, vertex, grid.withTangent)
+								&& (!checkNormals || glm::dot(candidate.normal, vertex.normal) >= minNormalDot)) {
+								best = other;
+							}
+						}
+					}
+				}
+			}
+			remap[v] = best;
+		}
+	}, threadCount);
+
+	// follow the chains so every vertex points at a vertex that is kept,
+	// remap[v] <= v so one pass in order is enough
+	uint32 keptCount = 0;
+	std::vector<uint32> newIndex(vertCount);
+	for (uint32 v = 0; v < vertCount; ++v) {
+		if (remap[v] == v) {
+			newIndex[v] = keptCount++;
+		}
+		else {
+			remap[v] = remap[remap[v]];
+			newIndex[v] = newIndex[remap[v]];
+		}
+	}
+
+	std::vector<Vertex> welded(keptCount);
+	for (uint32 v = 0; v < vertCount; ++v) {
+		if (remap[v] == v) {
+			welded[newIndex[v]] = verts[v];
+		}
+	}
+	// triangles that lost a corner to welding are dropped
+	size_t triangleCount = 0;
+	for (size_t i = 0; i + 2 < mesh.triangles.size(); i += 3) {
+		uint32 tri[3];
+		for (int k = 0; k < 3; ++k) {
+			uint32 index = mesh.triangles[i + k];
+			tri[k] = index < vertCount ? newIndex[index] : index;
+		}
+		if (tri[0] != tri[1] && tri[1] != tri[2] && tri[2] != tri[0]) {
+			mesh.triangles[triangleCount++] = tri[0];
+			mesh.triangles[triangleCount++] = tri[1];
+			mesh.triangles[triangleCount++] = tri[2];
+		}
+	}
+	size_t collapsed = mesh.triangles.size() / 3 - triangleCount / 3;
+	mesh.triangles.resize(triangleCount);
+	mesh.verts = std::move(welded);
+	logDebug("mesh converted to shared vertices, %d vertices welded into %d, %d collapsed triangles removed",
+		(int)vertCount, (int)keptCount, (int)collapsed);
+}
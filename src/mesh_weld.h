@@ -0,0 +1,23 @@
+#ifndef MESH_WELD_H
+#define MESH_WELD_H
+
+#include "main.h"
+
+/**
+ * @brief Converts a mesh between shared and unshared vertices.
+ *
+ * Sharing welds every vertex to the lowest numbered vertex within epsilon
+ * of it (0 only welds exact duplicates) with the same texture coordinates,
+ * the same tangent if the mesh has tangents, and a normal at most
+ * maxNormalAngle degrees away, 180 ignores normals. Welds chain, so a run
+ * of vertices each within epsilon of the next ends up as one vertex.
+ * Candidates are found through a spatial hash grid with epsilon sized
+ * cells, built and searched on up to maxThreads threads (0 uses one per
+ * core). The surviving vertices keep their order and triangles are
+ * rewritten to use them.
+ *
+ * Unsharing gives every triangle corner its own vertex.
+ */
+void shareVertices(Mesh& mesh, bool shareVerts, float epsilon = 0.0f, float maxNormalAngle = 180.0f, uint32 maxThreads = 0);
+
+#endif // MESH_WELD_H
@@ -0,0 +1,146 @@
+#include "meshlet.h"
+#include "mesh_bounds.h"
+
+#include "glm/common.hpp"
+#include "glm/geometric.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+static void computeMeshletBounds(const Mesh& mesh, Meshlet& meshlet)
+{
+	uint32 vertexCount = (uint32)mesh.verts.size();
+	glm::vec3 minBounds(FLT_MAX);
+	glm::vec3 maxBounds(-FLT_MAX);
+	glm::vec3 normalSum(0.0f);
+	uint32 end = meshlet.firstIndex + meshlet.indexCount;
+	for (uint32 i = meshlet.firstIndex; i < end; i += 3) {
+		const uint32* tri = &mesh.triangles[i];
+		if (tri[0] >= vertexCount || tri[1] >= vertexCount || tri[2] >= vertexCount) {
+			continue;
+		}
+		const glm::vec3& a = mesh.verts[tri[0]].location;
+		const glm::vec3& b = mesh.verts[tri[1]].location;
+		const glm::vec3& c = mesh.verts[tri[2]].location;
+		minBounds = glm::min(minBounds, glm::min(a, glm::min(b, c)));
+		maxBounds = glm::max(maxBounds, glm::max(a, glm::max(b, c)));
+		glm::vec3 normal = glm::cross(b - a, c - a);
+		float32 length = glm::length(normal);
+		if (length > 0.0f) {
+			normalSum += normal / length;
+		}
+	}
+	if (minBounds.x > maxBounds.x) {
+		// nothing valid to bound, keep it from ever being culled
+		meshlet.center = glm::vec3(0.0f);
+		meshlet.radius = FLT_MAX;
+		meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+		meshlet.coneCutoff = 1.0f;
+		return;
+	}
+
+	meshlet.center = (minBounds + maxBounds) * 0.5f;
+	float32 radius2 = 0.0f;
+	float32 axisLength = glm::length(normalSum);
+	meshlet.coneAxis = axisLength > 0.0f ? normalSum / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+	float32 minDot = axisLength > 0.0f ? 1.0f : -1.0f;
+	for (uint32 i = meshlet.firstIndex; i < end; i += 3) {
+		const uint32* tri = &mesh.triangles[i];
+		if (tri[0] >= vertexCount || tri[1] >= vertexCount || tri[2] >= vertexCount) {
+			continue;
+		}
+		for (int k = 0; k < 3; ++k) {
+			glm::vec3 d = mesh.verts[tri[k]].location - meshlet.center;
+			radius2 = std::max(radius2, glm::dot(d, d));
+		}
+		const glm::vec3& a = mesh.verts[tri[0]].location;
+		glm::vec3 normal = glm::cross(mesh.verts[tri[1]].location - a, mesh.verts[tri[2]].location - a);
+		float32 length = glm::length(normal);
+		if (length > 0.0f) {
+			minDot = std::min(minDot, glm::dot(normal / length, meshlet.coneAxis));
+		}
+	}
+	meshlet.radius = std::sqrt(radius2);
+	// the cone test is against the sine of the cone's half angle, a cone of
+	// 90 degrees or more can always be seen from somewhere in front
+	meshlet.coneCutoff = minDot > 0.0f ? std::sqrt(1.0f - minDot * minDot) : 1.0f;
+}
+
+void buildMeshlets(Mesh& mesh, uint32 maxVertices, uint32 maxTriangles)
+{
+	mesh.meshlets.clear();
+	uint32 vertexCount = (uint32)mesh.verts.size();
+	uint32 indexCount = (uint32)(mesh.triangles.size() / 3 * 3);
+
+	// the meshlet that last used each vertex, so new vertices are counted
+	// without clearing anything between meshlets
+	const uint32 noMeshlet = ~0u;
+	std::vector<uint32> usedBy(vertexCount, noMeshlet);
+	Meshlet meshlet = {};
+	uint32 meshletId = 0;
+	uint32 meshletVertices = 0;
+	auto newVertices = [&](const uint32* tri) {
+		uint32 count = 0;
+		for (int k = 0; k < 3; ++k) {
+			count += tri[k] < vertexCount && usedBy[tri[k]] != meshletId
+				&& (k < 1 || tri[k] != tri[0]) && (k < 2 || tri[k] != tri[1]);
+		}
+		return count;
+	};
+	for (uint32 i = 0; i < indexCount; i += 3) {
+		const uint32* tri = &mesh.triangles[i];
+		uint32 added = newVertices(tri);
+		if (meshlet.indexCount && (meshletVertices + added > maxVertices || meshlet.indexCount / 3 >= maxTriangles)) {
+			mesh.meshlets.push_back(meshlet);
+			meshlet.firstIndex = i;
+			meshlet.indexCount = 0;
+			meshletVertices = 0;
+			meshletId++;
+			added = newVertices(tri);
+		}
+		for (int k = 0; k < 3; ++k) {
+			if (tri[k] < vertexCount) {
+				usedBy[tri[k]] = meshletId;
+			}
+		}
+		meshletVertices += added;
+		meshlet.indexCount += 3;
+	}
+	if (meshlet.indexCount) {
+		mesh.meshlets.push_back(meshlet);
+	}
+	for (size_t m = 0; m < mesh.meshlets.size(); ++m) {
+		computeMeshletBounds(mesh, mesh.meshlets[m]);
+	}
+}
+
+uint32 cullMeshlets(const Mesh& mesh, const glm::mat4& mvp, const glm::vec3& cameraPosition,
+	bool coneCulling, std::vector<IndexRange>& ranges)
+{
+	glm::vec4 planes[6];
+	frustumPlanes(mvp, planes);
+
+	ranges.clear();
+	uint32 visible = 0;
+	for (size_t m = 0; m < mesh.meshlets.size(); ++m) {
+		const Meshlet& meshlet = mesh.meshlets[m];
+		bool inside = sphereInFrustum(planes, meshlet.center, meshlet.radius);
+		if (inside && coneCulling) {
+			glm::vec3 d = meshlet.center - cameraPosition;
+			inside = glm::dot(d, meshlet.coneAxis) < meshlet.coneCutoff * glm::length(d) + meshlet.radius;
+		}
+		if (!inside) {
+			continue;
+		}
+		visible++;
+		if (!ranges.empty() && ranges.back().firstIndex + ranges.back().indexCount == meshlet.firstIndex) {
+			ranges.back().indexCount += meshlet.indexCount;
+		}
+		else {
+			IndexRange range = { meshlet.firstIndex, meshlet.indexCount };
+			ranges.push_back(range);
+		}
+	}
+	return visible;
+}
@@ -0,0 +1,36 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include "main.h"
+
+#include "glm/mat4x4.hpp"
+
+#include <vector>
+
+const uint32 defaultMeshletVertices = 64;
+const uint32 defaultMeshletTriangles = 124;
+
+struct IndexRange
+{
+	uint32 firstIndex;
+	uint32 indexCount;
+};
+
+/**
+ * @brief Splits mesh.triangles into meshlets in their current order, so a
+ * vertex cache optimized mesh gives compact meshlets, each one using at
+ * most maxVertices vertices and maxTriangles triangles.
+ */
+void buildMeshlets(Mesh& mesh, uint32 maxVertices = defaultMeshletVertices,
+	uint32 maxTriangles = defaultMeshletTriangles);
+
+/**
+ * @brief Culls the meshlets of a mesh against the frustum of mvp and, with
+ * coneCulling, the ones that face away from a camera at cameraPosition
+ * (both in model space). Visible neighbours are merged into one range.
+ * @return the number of visible meshlets
+ */
+uint32 cullMeshlets(const Mesh& mesh, const glm::mat4& mvp, const glm::vec3& cameraPosition,
+	bool coneCulling, std::vector<IndexRange>& ranges);
+
+#endif // MESHLET_H
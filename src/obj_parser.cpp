@@ -0,0 +1,653 @@
+#include "obj_parser.h"
+#include "mapped_file.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OBJ_PARSER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// files are split into chunks of at least this many bytes for parallel parsing
+const size_t minChunkSize = 1 << 20;
+
+const uint32 invalidIndex = 0xFFFFFFFF;
+
+const float floatPow10[] = {
+	1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+const double doublePow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+	1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool isSpace(char ch) { return ch == ' ' || ch == '\t' || ch == '\r'; }
+inline bool isDigit(char ch) { return (unsigned)(ch - '0') < 10; }
+
+inline const char* skipSpaces(const char* p, const char* end)
+{
+	while (p < end && (*p == ' ' || *p == '\t')) { ++p; }
+	return p;
+}
+
+inline const char* skipLine(const char* p, const char* end)
+{
+	const char* eol = (const char*)memchr(p, '\n', end - p);
+	return eol ? eol + 1 : end;
+}
+
+inline const char* skipToken(const char* p, const char* end)
+{
+	while (p < end && !isSpace(*p) && *p != '\n') { ++p; }
+	return p;
+}
+
+/**
+ * Parses anything the fast path can't prove is correctly rounded (long
+ * mantissas, big exponents, inf/nan) with strtof on a terminated copy.
+ */
+bool parseFloatSlow(const char*& p, const char* end, float& out)
+{
+	char buffer[64];
+	size_t len = skipToken(p, end) - p;
+	if (len == 0 || len >= sizeof(buffer)) {
+		return false;
+	}
+	memcpy(buffer, p, len);
+	buffer[len] = '\0';
+	char* parsedEnd = 0;
+	out = strtof(buffer, &parsedEnd);
+	if (parsedEnd == buffer) {
+		return false;
+	}
+	p += parsedEnd - buffer;
+	return true;
+}
+
+/**
+ * Parses a decimal float, rounding exactly like strtof/sscanf("%f").
+ * Small mantissas and exponents are converted with a single IEEE multiply
+ * or divide which is exact, everything else falls back to strtof.
+ */
+bool parseFloat(const char*& p, const char* end, float& out)
+{
+	const char* start = p;
+	const char* s = p;
+	bool negative = false;
+	if (s < end && (*s == '-' || *s == '+')) {
+		negative = *s == '-';
+		++s;
+	}
+
+	uint64_t mantissa = 0;
+	int32 digits = 0;
+	int32 exponent = 0;
+	const char* digitsStart = s;
+	while (s < end && isDigit(*s)) {
+		mantissa = mantissa * 10 + (*s - '0');
+		digits += mantissa != 0;
+		++s;
+	}
+	bool anyDigits = s != digitsStart;
+	if (s < end && *s == '.') {
+		++s;
+		const char* fractionStart = s;
+		while (s < end && isDigit(*s)) {
+			mantissa = mantissa * 10 + (*s - '0');
+			digits += mantissa != 0;
+			++s;
+		}
+		exponent -= (int32)(s - fractionStart);
+		anyDigits |= s != fractionStart;
+	}
+	if (!anyDigits || digits > 19) {
+		return parseFloatSlow(p, end, out);
+	}
+	if (s < end && (*s == 'e' || *s == 'E')) {
+		const char* e = s + 1;
+		bool expNegative = false;
+		if (e < end && (*e == '-' || *e == '+')) {
+			expNegative = *e == '-';
+			++e;
+		}
+		if (e < end && isDigit(*e)) {
+			int32 value = 0;
+			while (e < end && isDigit(*e)) {
+				if (value < 10000) { value = value * 10 + (*e - '0'); }
+				++e;
+			}
+			exponent += expNegative ? -value : value;
+			s = e;
+		}
+	}
+	if (s < end && !isSpace(*s) && *s != '\n' && *s != '/') {
+		// something like a hex float or a trailing suffix
+		p = start;
+		return parseFloatSlow(p, end, out);
+	}
+
+	if (mantissa == 0) {
+		out = negative ? -0.0f : 0.0f;
+	}
+	else if (mantissa <= (1u << 24) && exponent >= -10 && exponent <= 10) {
+		float f = (float)mantissa;
+		f = exponent < 0 ? f / floatPow10[-exponent] : f * floatPow10[exponent];
+		out = negative ? -f : f;
+	}
+	else if (mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+		double d = (double)mantissa;
+		d = exponent < 0 ? d / doublePow10[-exponent] : d * doublePow10[exponent];
+		// rounding to double then to float is only ambiguous when the double
+		// landed exactly halfway between two floats
+		uint64_t bits;
+		memcpy(&bits, &d, sizeof(bits));
+		if ((bits & 0x1FFFFFFF) == 0x10000000 || d < FLT_MIN || d > FLT_MAX) {
+			p = start;
+			return parseFloatSlow(p, end, out);
+		}
+		out = negative ? -(float)d : (float)d;
+	}
+	else {
+		p = start;
+		return parseFloatSlow(p, end, out);
+	}
+	p = s;
+	return true;
+}
+
+inline bool parseInt(const char*& p, const char* end, int32& out)
+{
+	const char* s = p;
+	bool negative = false;
+	if (s < end && (*s == '-' || *s == '+')) {
+		negative = *s == '-';
+		++s;
+	}
+	if (s == end || !isDigit(*s)) {
+		return false;
+	}
+	// saturates instead of overflowing, an index that big is out of range
+	// for any mesh and gets dropped like other invalid indices
+	const int64_t maxValue = 0x7FFFFFFF;
+	int64_t value = 0;
+	while (s < end && isDigit(*s)) {
+		if (value <= maxValue) {
+			value = value * 10 + (*s - '0');
+		}
+		++s;
+	}
+	value = std::min(value, maxValue);
+	out = (int32)(negative ? -value : value);
+	p = s;
+	return true;
+}
+
+inline void parseVec3(const char* p, const char* end, glm::vec3& v)
+{
+	for (int i = 0; i < 3; ++i) {
+		p = skipSpaces(p, end);
+		if (!parseFloat(p, end, v[i])) {
+			break;
+		}
+	}
+}
+
+inline uint32 popCount16(uint32 bits)
+{
+	bits = bits - ((bits >> 1) & 0x5555);
+	bits = (bits & 0x3333) + ((bits >> 2) & 0x3333);
+	bits = (bits + (bits >> 4)) & 0x0F0F;
+	return (bits + (bits >> 8)) & 0x1F;
+}
+
+/**
+ * Counts the whitespace separated tokens in [p, end), which is what the
+ * corners of a face line are. Token starts are found 16 bytes at a time as
+ * the non-space bytes whose previous byte is a space.
+ */
+uint32 countTokens(const char* p, const char* end)
+{
+	uint32 count = 0;
+	uint32 inToken = 0;
+#ifdef OBJ_PARSER_SSE2
+	const __m128i spaces = _mm_set1_epi8(' ');
+	const __m128i tabs = _mm_set1_epi8('\t');
+	const __m128i returns = _mm_set1_epi8('\r');
+	const __m128i newlines = _mm_set1_epi8('\n');
+	while (end - p >= 16) {
+		__m128i bytes = _mm_loadu_si128((const __m128i*)p);
+		__m128i space = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(bytes, spaces), _mm_cmpeq_epi8(bytes, tabs)),
+			_mm_or_si128(_mm_cmpeq_epi8(bytes, returns), _mm_cmpeq_epi8(bytes, newlines)));
+		uint32 token = ~(uint32)_mm_movemask_epi8(space) & 0xFFFF;
+		count += popCount16(token & ~((token << 1) | inToken));
+		inToken = token >> 15;
+		p += 16;
+	}
+#endif
+	for (; p < end; ++p) {
+		uint32 token = !isSpace(*p) && *p != '\n';
+		count += token & ~inToken;
+		inToken = token;
+	}
+	return count;
+}
+
+struct ObjMeshStart
+{
+	uint32 position;
+	uint32 normal;
+	uint32 index;
+};
+
+struct ObjName
+{
+	uint32 index;
+	std::string name;
+};
+
+/**
+ * The parsed contents of a newline aligned slice of the file. Counts in
+ * meshStarts and names are local to the chunk until the fix-up pass adds
+ * the chunk's bases to them.
+ */
+struct ObjChunk
+{
+	const char* begin;
+	const char* end;
+
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	// 0-based indices, global for positive obj indices and relative to the
+	// chunk's first position for negative ones
+	std::vector<int32> indices;
+	// offsets into indices of the entries that are chunk relative
+	std::vector<uint32> relativeIndices;
+	std::vector<ObjMeshStart> meshStarts;
+	std::vector<ObjName> names;
+	std::vector<int32> face;
+	std::vector<uint8_t> faceRelative;
+
+	uint32 positionBase;
+	uint32 normalBase;
+	uint32 indexBase;
+	uint32 invalidIndices;
+	uint32 reallocations;
+
+	bool hasVertexOrFace;
+	// the first vertex or face line is vertex data
+	bool startsWithVertex;
+	bool lastLineWasFace;
+};
+
+void parseFace(ObjChunk& chunk, const char* p, const char* end)
+{
+	std::vector<int32>& face = chunk.face;
+	std::vector<uint8_t>& faceRelative = chunk.faceRelative;
+	face.clear();
+	faceRelative.clear();
+	int32 vertexCount = (int32)chunk.positions.size();
+	while (true) {
+		p = skipSpaces(p, end);
+		if (p == end || *p == '\n' || *p == '\r') {
+			break;
+		}
+		int32 v = 0;
+		if (!parseInt(p, end, v)) {
+			break;
+		}
+		// ignore the texture coord and normal parts of v/vt/vn
+		p = skipToken(p, end);
+		if (v == 0) {
+			continue;
+		}
+		// make indices 0-based, negative ones are rebased by the fix-up pass
+		face.push_back(v < 0 ? v + vertexCount : v - 1);
+		faceRelative.push_back(v < 0);
+	}
+	if (face.size() < 3) {
+		return;
+	}
+	for (size_t i = 2; i < face.size(); ++i) {
+		size_t corners[3] = { 0, i - 1, i };
+		for (int c = 0; c < 3; ++c) {
+			if (faceRelative[corners[c]]) {
+				chunk.relativeIndices.push_back((uint32)chunk.indices.size());
+			}
+			pushCounted(chunk.indices, face[corners[c]], chunk.reallocations);
+		}
+	}
+}
+
+void parseChunk(ObjChunk& chunk)
+{
+	const char* p = chunk.begin;
+	const char* end = chunk.end;
+
+	// counting first is much cheaper than parsing and lets the big arrays
+	// be allocated once at their final size
+	ObjCounts counts = {};
+	countObj(p, end - p, counts);
+	chunk.positions.reserve(counts.positions);
+	chunk.normals.reserve(counts.normals);
+	chunk.indices.reserve((size_t)counts.triangles * 3);
+	while (p < end) {
+		p = skipSpaces(p, end);
+		if (p == end) {
+			break;
+		}
+		const char* eol = skipLine(p, end);
+		switch (*p)
+		{
+		case 'v':
+		{
+			if (!chunk.hasVertexOrFace) {
+				chunk.hasVertexOrFace = true;
+				chunk.startsWithVertex = true;
+			}
+			else if (chunk.lastLineWasFace) {
+				ObjMeshStart start = {
+					(uint32)chunk.positions.size(),
+					(uint32)chunk.normals.size(),
+					(uint32)chunk.indices.size()
+				};
+				chunk.meshStarts.push_back(start);
+			}
+			chunk.lastLineWasFace = false;
+			char type = p + 1 < end ? p[1] : '\n';
+			if (type == ' ' || type == '\t') {
+				pushCounted(chunk.positions, glm::vec3(0.0f), chunk.reallocations);
+				parseVec3(p + 2, eol, chunk.positions.back());
+			}
+			else if (type == 'n') {
+				pushCounted(chunk.normals, glm::vec3(0.0f), chunk.reallocations);
+				parseVec3(p + 2, eol, chunk.normals.back());
+			}
+			// texture coords aren't used yet
+			break;
+		}
+		case 'f':
+			chunk.hasVertexOrFace = true;
+			parseFace(chunk, p + 1, eol);
+			chunk.lastLineWasFace = true;
+			break;
+		case 'o':
+		case 'g':
+		{
+			const char* s = skipSpaces(p + 1, eol);
+			const char* e = eol;
+			while (e > s && (isSpace(e[-1]) || e[-1] == '\n')) { --e; }
+			ObjName name = { (uint32)chunk.indices.size(), std::string(s, e) };
+			chunk.names.push_back(std::move(name));
+			break;
+		}
+		default:
+			break;
+		}
+		p = eol;
+	}
+}
+
+/**
+ * Finds the last mesh segment starting at or before the global element at
+ * offset, where member selects which count of the starts to search.
+ */
+size_t findSegment(const std::vector<ObjMeshStart>& starts, uint32 ObjMeshStart::*member, uint32 offset)
+{
+	size_t lo = 0;
+	size_t hi = starts.size() - 1;
+	while (lo + 1 < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (starts[mid].*member <= offset) { lo = mid; }
+		else { hi = mid; }
+	}
+	return lo;
+}
+
+/**
+ * Copies a chunk's data into the meshes that own it. Every chunk writes a
+ * disjoint part of the meshes so chunks can be copied in parallel.
+ */
+void copyChunk(ObjChunk& chunk, const std::vector<ObjMeshStart>& starts, const std::vector<Mesh*>& segmentMeshes)
+{
+	if (!chunk.positions.empty()) {
+		size_t seg = findSegment(starts, &ObjMeshStart::position, chunk.positionBase);
+		for (size_t i = 0; i < chunk.positions.size(); ++i) {
+			uint32 g = chunk.positionBase + (uint32)i;
+			while (starts[seg + 1].position <= g) { ++seg; }
+			segmentMeshes[seg]->verts[g - starts[seg].position].location = chunk.positions[i];
+		}
+	}
+
+	if (!chunk.normals.empty()) {
+		size_t seg = findSegment(starts, &ObjMeshStart::normal, chunk.normalBase);
+		for (size_t i = 0; i < chunk.normals.size(); ++i) {
+			uint32 g = chunk.normalBase + (uint32)i;
+			while (starts[seg + 1].normal <= g) { ++seg; }
+			Mesh* mesh = segmentMeshes[seg];
+			uint32 local = g - starts[seg].normal;
+			if (mesh && local < mesh->verts.size()) {
+				mesh->verts[local].normal = chunk.normals[i];
+			}
+		}
+	}
+
+	if (!chunk.indices.empty()) {
+		size_t seg = findSegment(starts, &ObjMeshStart::index, chunk.indexBase);
+		size_t nextRelative = 0;
+		for (size_t i = 0; i < chunk.indices.size(); ++i) {
+			uint32 g = chunk.indexBase + (uint32)i;
+			while (starts[seg + 1].index <= g) { ++seg; }
+			int64_t index = chunk.indices[i];
+			if (nextRelative < chunk.relativeIndices.size() && chunk.relativeIndices[nextRelative] == i) {
+				index += chunk.positionBase;
+				nextRelative++;
+			}
+			Mesh* mesh = segmentMeshes[seg];
+			if (!mesh) {
+				chunk.invalidIndices++;
+				continue;
+			}
+			// make the index relative to the mesh's first vertex
+			index -= starts[seg].position;
+			if (index < 0 || index >= (int64_t)mesh->verts.size()) {
+				chunk.invalidIndices++;
+				index = invalidIndex;
+			}
+			mesh->triangles[g - starts[seg].index] = (uint32)index;
+		}
+	}
+}
+
+void removeInvalidTriangles(Mesh& mesh)
+{
+	size_t count = 0;
+	for (size_t i = 0; i + 2 < mesh.triangles.size(); i += 3) {
+		uint32 a = mesh.triangles[i];
+		uint32 b = mesh.triangles[i + 1];
+		uint32 c = mesh.triangles[i + 2];
+		if (a != invalidIndex && b != invalidIndex && c != invalidIndex) {
+			mesh.triangles[count++] = a;
+			mesh.triangles[count++] = b;
+			mesh.triangles[count++] = c;
+		}
+	}
+	mesh.triangles.resize(count);
+}
+
+} // namespace
+
+void countObj(const char* data, size_t size, ObjCounts& total, std::vector<ObjCounts>* groups)
+{
+	ObjCounts group = {};
+	const char* p = data;
+	const char* end = data + size;
+	while (p < end) {
+		p = skipSpaces(p, end);
+		if (p == end) {
+			break;
+		}
+		const char* eol = skipLine(p, end);
+		char type = p + 1 < eol ? p[1] : '\n';
+		bool spaced = type == ' ' || type == '\t';
+		if (*p == 'v') {
+			group.positions += spaced;
+			group.normals += type == 'n';
+			group.texcoords += type == 't';
+		}
+		else if (*p == 'f' && spaced) {
+			uint32 corners = countTokens(p + 1, eol);
+			group.faces++;
+			group.quads += corners == 4;
+			group.triangles += corners >= 3 ? corners - 2 : 0;
+		}
+		else if ((*p == 'o' || *p == 'g') && spaced && groups && group.faces) {
+			groups->push_back(group);
+			memset(&group, 0, sizeof(group));
+		}
+		p = eol;
+	}
+	if (groups) {
+		groups->push_back(group);
+		memset(&total, 0, sizeof(total));
+		for (size_t i = 0; i < groups->size(); ++i) {
+			const ObjCounts& g = (*groups)[i];
+			total.positions += g.positions;
+			total.normals += g.normals;
+			total.texcoords += g.texcoords;
+			total.faces += g.faces;
+			total.quads += g.quads;
+			total.triangles += g.triangles;
+		}
+	}
+	else {
+		total = group;
+	}
+}
+
+void loadObj(const std::string& objPath, std::vector<Mesh>& meshes, uint32 maxThreads)
+{
+	MappedFile file;
+	if (!mapFile(file, objPath)) {
+		logError("Failed to open obj file %s", objPath.c_str());
+		return;
+	}
+
+	// split the file into newline aligned chunks, a few per thread so
+	// uneven chunks balance out
+	uint32 threadCount = maxThreads ? maxThreads : workerCount();
+	size_t chunkCount = 1;
+	if (threadCount > 1) {
+		chunkCount = std::min((size_t)threadCount * 4, std::max(file.size / minChunkSize, (size_t)1));
+	}
+	std::vector<ObjChunk> chunks(chunkCount);
+	const char* end = file.data + file.size;
+	const char* p = file.data;
+	for (size_t i = 0; i < chunkCount; ++i) {
+		chunks[i].begin = p;
+		if (i + 1 < chunkCount) {
+			const char* target = file.data + file.size / chunkCount * (i + 1);
+			p = target > p ? skipLine(target, end) : p;
+		}
+		else {
+			p = end;
+		}
+		chunks[i].end = p;
+	}
+
+	parallelFor((uint32)chunkCount, [&](uint32 i) {
+		parseChunk(chunks[i]);
+	}, threadCount);
+
+	// prefix sum the chunk counts and join up the mesh boundaries, a chunk
+	// starting with vertex data after a chunk that ended on a face starts a
+	// new mesh just like it would within a chunk
+	std::vector<ObjMeshStart> starts;
+	std::vector<const ObjName*> names;
+	ObjMeshStart first = {};
+	starts.push_back(first);
+	ObjMeshStart total = {};
+	bool lastLineWasFace = false;
+	for (size_t i = 0; i < chunkCount; ++i) {
+		ObjChunk& chunk = chunks[i];
+		chunk.positionBase = total.position;
+		chunk.normalBase = total.normal;
+		chunk.indexBase = total.index;
+		if (chunk.hasVertexOrFace) {
+			if (lastLineWasFace && chunk.startsWithVertex) {
+				starts.push_back(total);
+			}
+			for (size_t j = 0; j < chunk.meshStarts.size(); ++j) {
+				ObjMeshStart start = chunk.meshStarts[j];
+				start.position += total.position;
+				start.normal += total.normal;
+				start.index += total.index;
+				starts.push_back(start);
+			}
+			lastLineWasFace = chunk.lastLineWasFace;
+		}
+		for (size_t j = 0; j < chunk.names.size(); ++j) {
+			chunk.names[j].index += total.index;
+			names.push_back(&chunk.names[j]);
+		}
+		total.position += (uint32)chunk.positions.size();
+		total.normal += (uint32)chunk.normals.size();
+		total.index += (uint32)chunk.indices.size();
+	}
+	// sentinel so every segment has an end
+	starts.push_back(total);
+
+	size_t segmentCount = starts.size() - 1;
+	size_t meshCount = 0;
+	for (size_t i = 0; i < segmentCount; ++i) {
+		meshCount += starts[i + 1].position > starts[i].position;
+	}
+	size_t firstMesh = meshes.size();
+	meshes.resize(firstMesh + meshCount);
+
+	std::vector<Mesh*> segmentMeshes(segmentCount, (Mesh*)0);
+	size_t nextName = 0;
+	const std::string* name = 0;
+	for (size_t i = 0, m = firstMesh; i < segmentCount; ++i) {
+		// a mesh is named by the last 'o' or 'g' seen before its first face
+		while (nextName < names.size() && names[nextName]->index <= starts[i].index) {
+			name = &names[nextName++]->name;
+		}
+		if (starts[i + 1].position == starts[i].position) {
+			continue;
+		}
+		Mesh& mesh = meshes[m++];
+		mesh.verts.resize(starts[i + 1].position - starts[i].position);
+		mesh.triangles.resize(starts[i + 1].index - starts[i].index);
+		if (name && starts[i + 1].index > starts[i].index) {
+			mesh.name = *name;
+		}
+		segmentMeshes[i] = &mesh;
+	}
+
+	parallelFor((uint32)chunkCount, [&](uint32 i) {
+		copyChunk(chunks[i], starts, segmentMeshes);
+	}, threadCount);
+
+	uint32 invalidIndices = 0;
+	uint32 reallocations = 0;
+	for (size_t i = 0; i < chunkCount; ++i) {
+		invalidIndices += chunks[i].invalidIndices;
+		reallocations += chunks[i].reallocations;
+	}
+	if (invalidIndices) {
+		for (size_t i = firstMesh; i < meshes.size(); ++i) {
+			removeInvalidTriangles(meshes[i]);
+		}
+		logError("skipped %d out of range indices in %s", invalidIndices, objPath.c_str());
+	}
+	unmapFile(file);
+	logDebug("parsed %d meshes from %d chunks on %d threads, %d reallocations", (int)meshCount, (int)chunkCount, (int)threadCount, (int)reallocations);
+}
@@ -0,0 +1,45 @@
+#ifndef OBJ_PARSER_H
+#define OBJ_PARSER_H
+
+#include "main.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Loads an obj file by tokenizing it straight out of a memory mapping.
+ *
+ * A new mesh is started whenever vertex data follows a face, face indices are
+ * rebased so each mesh only references its own vertices, and the n-th normal
+ * of a mesh is assigned to its n-th vertex. Faces with more than three
+ * vertices are triangulated as a fan.
+ *
+ * Big files are split into newline aligned chunks that are parsed on up to
+ * maxThreads threads (0 uses one per core) and stitched back together.
+ */
+void loadObj(const std::string& objPath, std::vector<Mesh>& meshes, uint32 maxThreads = 0);
+
+/**
+ * @brief Element counts of an obj file or a part of it.
+ */
+struct ObjCounts
+{
+	uint32 positions;
+	uint32 normals;
+	uint32 texcoords;
+	uint32 faces;
+	// faces with exactly four corners
+	uint32 quads;
+	// triangles after fan triangulating every face
+	uint32 triangles;
+};
+
+/**
+ * @brief Counts the lines of an obj file without parsing any numbers, so a
+ * loader can reserve exactly sized buffers before the real parse.
+ * When groups is given it gets one entry per shape the way tinyobj splits
+ * them, where a 'g' or 'o' line after a face starts the next shape.
+ */
+void countObj(const char* data, size_t size, ObjCounts& total, std::vector<ObjCounts>* groups = 0);
+
+#endif // OBJ_PARSER_H
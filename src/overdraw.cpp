@@ -0,0 +1,254 @@
+#include "overdraw.h"
+
+#include "glm/common.hpp"
+#include "glm/geometric.hpp"
+
+#include <algorithm>
+#include <cfloat>
+
+namespace {
+
+const int32 overdrawResolution = 256;
+
+struct OverdrawTarget
+{
+	std::vector<float> depth;
+	uint32 shaded;
+};
+
+void rasterizeTriangle(OverdrawTarget& target, glm::vec3 a, glm::vec3 b, glm::vec3 c)
+{
+	// make the winding consistent so the edge functions are positive inside,
+	// both sides are drawn anyway
+	float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	if (area == 0.0f) {
+		return;
+	}
+	if (area < 0.0f) {
+		std::swap(b, c);
+		area = -area;
+	}
+	int32 minX = std::max((int32)std::floor(std::min(a.x, std::min(b.x, c.x))), 0);
+	int32 minY = std::max((int32)std::floor(std::min(a.y, std::min(b.y, c.y))), 0);
+	int32 maxX = std::min((int32)std::ceil(std::max(a.x, std::max(b.x, c.x))), overdrawResolution - 1);
+	int32 maxY = std::min((int32)std::ceil(std::max(a.y, std::max(b.y, c.y))), overdrawResolution - 1);
+	for (int32 y = minY; y <= maxY; ++y) {
+		for (int32 x = minX; x <= maxX; ++x) {
+			// sample at pixel centers
+			float px = x + 0.5f;
+			float py = y + 0.5f;
+			float w0 = (c.x - b.x) * (py - b.y) - (c.y - b.y) * (px - b.x);
+			float w1 = (a.x - c.x) * (py - c.y) - (a.y - c.y) * (px - c.x);
+			float w2 = (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+			if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) {
+				continue;
+			}
+			float z = (w0 * a.z + w1 * b.z + w2 * c.z) / area;
+			float& depth = target.depth[y * overdrawResolution + x];
+			if (z < depth) {
+				depth = z;
+				target.shaded++;
+			}
+		}
+	}
+}
+
+} // namespace
+
+OverdrawStats analyzeOverdraw(const std::vector<uint32>& triangles, const std::vector<Vertex>& verts)
+{
+	OverdrawStats stats = {};
+	if (verts.empty()) {
+		return stats;
+	}
+
+	glm::vec3 minBounds(FLT_MAX);
+	glm::vec3 maxBounds(-FLT_MAX);
+	for (size_t i = 0; i < verts.size(); ++i) {
+		minBounds = glm::min(minBounds, verts[i].location);
+		maxBounds = glm::max(maxBounds, verts[i].location);
+	}
+	glm::vec3 extent = maxBounds - minBounds;
+	float scale = std::max(extent.x, std::max(extent.y, extent.z));
+	scale = scale > 0.0f ? (overdrawResolution - 1) / scale : 0.0f;
+
+	OverdrawTarget target;
+	for (int axis = 0; axis < 3; ++axis) {
+		for (int side = 0; side < 2; ++side) {
+			// look down axis from either side, the other two axes are screen
+			// space and depth is flipped for the back view
+			int32 sx = (axis + 1) % 3;
+			int32 sy = (axis + 2) % 3;
+			float depthSign = side ? -1.0f : 1.0f;
+			target.depth.assign(overdrawResolution * overdrawResolution, FLT_MAX);
+			target.shaded = 0;
+			for (size_t t = 0; t + 2 < triangles.size(); t += 3) {
+				glm::vec3 p[3];
+				bool valid = true;
+				for (int k = 0; k < 3; ++k) {
+					uint32 index = triangles[t + k];
+					if (index >= verts.size()) {
+						valid = false;
+						break;
+					}
+					glm::vec3 v = (verts[index].location - minBounds) * scale;
+					p[k] = glm::vec3(v[sx], v[sy], v[axis] * depthSign);
+				}
+				if (valid) {
+					rasterizeTriangle(target, p[0], p[1], p[2]);
+				}
+			}
+			for (size_t i = 0; i < target.depth.size(); ++i) {
+				stats.pixelsCovered += target.depth[i] != FLT_MAX;
+			}
+			stats.pixelsShaded += target.shaded;
+		}
+	}
+	stats.overdraw = stats.pixelsCovered ? (float)stats.pixelsShaded / stats.pixelsCovered : 0.0f;
+	return stats;
+}
+
+namespace {
+
+/**
+ * A small fifo cache simulation that can be restarted at any triangle.
+ */
+struct CacheSimulation
+{
+	std::vector<uint32> loadedAt;
+	uint32 misses;
+	uint32 cacheSize;
+};
+
+void resetCache(CacheSimulation& cache)
+{
+	// stamps are misses + cacheSize so a reset invalidates everything loaded
+	cache.misses += cache.cacheSize + 1;
+}
+
+uint32 simulateTriangle(CacheSimulation& cache, const uint32* tri)
+{
+	uint32 misses = 0;
+	for (int k = 0; k < 3; ++k) {
+		uint32& loaded = cache.loadedAt[tri[k]];
+		if (loaded == 0 || cache.misses - loaded >= cache.cacheSize) {
+			cache.misses++;
+			loaded = cache.misses;
+			misses++;
+		}
+	}
+	return misses;
+}
+
+struct OverdrawCluster
+{
+	uint32 first;
+	uint32 count;
+	float sortKey;
+};
+
+} // namespace
+
+void optimizeOverdraw(std::vector<uint32>& triangles, const std::vector<Vertex>& verts,
+	float threshold, uint32 cacheSize)
+{
+	uint32 vertexCount = (uint32)verts.size();
+	uint32 triCount = (uint32)(triangles.size() / 3);
+	for (uint32 i = 0; i < triCount * 3; ++i) {
+		if (triangles[i] >= vertexCount) {
+			logError("optimizeOverdraw skipped a mesh with out of range indices");
+			return;
+		}
+	}
+	if (triCount < 2) {
+		return;
+	}
+
+	// hard boundaries where the cache order restarts, every vertex missing
+	CacheSimulation cache = { std::vector<uint32>(vertexCount, 0), 0, cacheSize };
+	std::vector<uint32> hardBoundaries;
+	for (uint32 t = 0; t < triCount; ++t) {
+		if (simulateTriangle(cache, &triangles[t * 3]) == 3) {
+			hardBoundaries.push_back(t);
+		}
+	}
+	hardBoundaries.push_back(triCount);
+
+	// soft boundaries inside each hard cluster, as soon as the running miss
+	// ratio is within threshold of the whole cluster's
+	std::vector<OverdrawCluster> clusters;
+	for (size_t h = 0; h + 1 < hardBoundaries.size(); ++h) {
+		uint32 begin = hardBoundaries[h];
+		uint32 end = hardBoundaries[h + 1];
+		resetCache(cache);
+		uint32 clusterMisses = 0;
+		for (uint32 t = begin; t < end; ++t) {
+			clusterMisses += simulateTriangle(cache, &triangles[t * 3]);
+		}
+		float clusterAcmr = (float)clusterMisses / (end - begin);
+
+		resetCache(cache);
+		uint32 first = begin;
+		uint32 misses = 0;
+		for (uint32 t = begin; t < end; ++t) {
+			misses += simulateTriangle(cache, &triangles[t * 3]);
+			uint32 count = t + 1 - first;
+			if (t + 1 < end && (float)misses / count <= clusterAcmr * threshold) {
+				OverdrawCluster cluster = { first, count, 0.0f };
+				clusters.push_back(cluster);
+				first = t + 1;
+				misses = 0;
+				resetCache(cache);
+			}
+		}
+		OverdrawCluster cluster = { first, end - first, 0.0f };
+		clusters.push_back(cluster);
+	}
+
+	// sort key is how far a cluster's centroid lies along its own normal
+	// from the mesh centroid, outer clusters facing outwards go first
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	std::vector<glm::vec3> clusterCentroids(clusters.size());
+	std::vector<glm::vec3> clusterNormals(clusters.size());
+	for (size_t c = 0; c < clusters.size(); ++c) {
+		glm::vec3 centroid(0.0f);
+		glm::vec3 normal(0.0f);
+		float area = 0.0f;
+		for (uint32 t = clusters[c].first; t < clusters[c].first + clusters[c].count; ++t) {
+			const glm::vec3& a = verts[triangles[t * 3 + 0]].location;
+			const glm::vec3& b = verts[triangles[t * 3 + 1]].location;
+			const glm::vec3& d = verts[triangles[t * 3 + 2]].location;
+			glm::vec3 cross = glm::cross(b - a, d - a);
+			float triArea = glm::length(cross);
+			centroid += (a + b + d) * (triArea / 3.0f);
+			normal += cross;
+			area += triArea;
+		}
+		clusterCentroids[c] = area > 0.0f ? centroid / area : centroid;
+		clusterNormals[c] = normal;
+		meshCentroid += centroid;
+		meshArea += area;
+	}
+	if (meshArea > 0.0f) {
+		meshCentroid /= meshArea;
+	}
+	for (size_t c = 0; c < clusters.size(); ++c) {
+		float length = glm::length(clusterNormals[c]);
+		glm::vec3 normal = length > 0.0f ? clusterNormals[c] / length : glm::vec3(0.0f);
+		clusters[c].sortKey = glm::dot(clusterCentroids[c] - meshCentroid, normal);
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), [](const OverdrawCluster& a, const OverdrawCluster& b) {
+		return a.sortKey > b.sortKey;
+	});
+
+	std::vector<uint32> output;
+	output.reserve(triangles.size());
+	for (size_t c = 0; c < clusters.size(); ++c) {
+		const uint32* first = &triangles[clusters[c].first * 3];
+		output.insert(output.end(), first, first + clusters[c].count * 3);
+	}
+	// anything past the last whole triangle stays where it was
+	output.insert(output.end(), triangles.begin() + triCount * 3, triangles.end());
+	triangles.swap(output);
+}
@@ -0,0 +1,63 @@
+#include "parallel.h"
+#include "sdl.h"
+
+#include <algorithm>
+#include <vector>
+
+struct ParallelJob
+{
+	const std::function<void(uint32)>* fn;
+	uint32 count;
+	SDL_atomic_t next;
+};
+
+static void runParallelJob(ParallelJob* job)
+{
+	while (true) {
+		uint32 i = (uint32)SDL_AtomicAdd(&job->next, 1);
+		if (i >= job->count) {
+			break;
+		}
+		(*job->fn)(i);
+	}
+}
+
+static int parallelJobThread(void* data)
+{
+	runParallelJob((ParallelJob*)data);
+	return 0;
+}
+
+uint32 workerCount()
+{
+	int count = SDL_GetCPUCount();
+	return count > 1 ? (uint32)count : 1;
+}
+
+void parallelFor(uint32 count, const std::function<void(uint32)>& fn, uint32 maxThreads)
+{
+	uint32 threadCount = std::min(maxThreads ? maxThreads : workerCount(), count);
+	if (threadCount <= 1) {
+		for (uint32 i = 0; i < count; ++i) {
+			fn(i);
+		}
+		return;
+	}
+
+	ParallelJob job = {};
+	job.fn = &fn;
+	job.count = count;
+
+	// the calling thread works too, so one less thread is needed
+	std::vector<SDL_Thread*> threads;
+	for (uint32 i = 1; i < threadCount; ++i) {
+		SDL_Thread* thread = SDL_CreateThread(parallelJobThread, "parallelFor", &job);
+		if (thread) {
+			threads.push_back(thread);
+		}
+	}
+	runParallelJob(&job);
+	for (size_t i = 0; i < threads.size(); ++i) {
+		SDL_WaitThread(threads[i], 0);
+	}
+}
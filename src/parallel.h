@@ -0,0 +1,20 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "main.h"
+
+#include <functional>
+
+/**
+ * @brief Number of threads parallelFor will use, at least 1.
+ */
+uint32 workerCount();
+
+/**
+ * @brief Runs fn(i) for every i in [0, count) on up to maxThreads SDL threads
+ * (0 uses workerCount()) and returns once all of them have finished.
+ * Items are handed out one at a time so uneven items balance out.
+ */
+void parallelFor(uint32 count, const std::function<void(uint32)>& fn, uint32 maxThreads = 0);
+
+#endif // PARALLEL_H
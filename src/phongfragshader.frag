@@ -16,7 +16,12 @@ void main()
     vec3 ambient = ambientStrength * u_lightColor;
 
     // Diffuse 
+#ifdef FLAT_SHADING
+    // the face normal, FragPos changes only within the triangle's plane
+    vec3 norm = normalize(cross(dFdx(FragPos), dFdy(FragPos)));
+#else
     vec3 norm = normalize(Normal);
+#endif
     vec3 lightDir = normalize(u_lightPos - FragPos);
     float diff = max(dot(norm, lightDir), 0.0);
     vec3 diffuse = diff * u_lightColor;
@@ -2,16 +2,42 @@
 
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
+// xyz tangent, w the bitangent sign, see packTangent
+layout (location = 2) in vec4 tangent;
+layout (location = 3) in vec2 texCoord;
 
 out vec3 Normal;
 out vec3 FragPos;
+out vec4 Tangent;
+out vec2 TexCoord;
 
 uniform mat4 u_M;
 uniform mat4 u_MVP;
 
+// quantized meshes have 16 bit unorm positions within their bounding box
+// and octahedral normals in the first two components of normal, for full
+// float meshes offset is 0 and scale 1
+uniform bool u_quantized;
+uniform vec3 u_positionOffset;
+uniform vec3 u_positionScale;
+
+vec3 decodeNormal(vec2 encoded)
+{
+    vec2 e = encoded * 2.0f - 1.0f;
+    vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return normalize(n);
+}
+
 void main()
 {
-    gl_Position = u_MVP * vec4(position, 1.0f);
-    FragPos = vec3(u_M * vec4(position, 1.0f));
-    Normal = normal;
+    vec3 p = u_positionOffset + position * u_positionScale;
+    gl_Position = u_MVP * vec4(p, 1.0f);
+    FragPos = vec3(u_M * vec4(p, 1.0f));
+    Normal = u_quantized ? decodeNormal(normal.xy) : normal;
+    // older drivers decode the 2 bit w as -1/3 instead of -1
+    Tangent = vec4(tangent.xyz, tangent.w < 0.0f ? -1.0f : 1.0f);
+    TexCoord = texCoord;
 } 
@@ -343,6 +343,24 @@ namespace tinyobj {
 #include <fstream>
 #include <sstream>
 
+// Number scanning classifies 32 (AVX2) or 16 (SSE2) bytes at a time, define
+// TINYOBJLOADER_NO_SIMD to force the scalar code.
+#if !defined(TINYOBJLOADER_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define TINYOBJ_SIMD_WIDTH 32
+#elif !defined(TINYOBJLOADER_NO_SIMD) && \
+    (defined(__SSE2__) || defined(_M_X64) || \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define TINYOBJ_SIMD_WIDTH 16
+#else
+#define TINYOBJ_SIMD_WIDTH 0
+#endif
+
+#if TINYOBJ_SIMD_WIDTH && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 namespace tinyobj {
 
 	MaterialReader::~MaterialReader() {}
@@ -407,6 +425,168 @@ namespace tinyobj {
   (static_cast<unsigned int>((x) - '0') < static_cast<unsigned int>(10))
 #define IS_NEW_LINE(x) (((x) == '\r') || ((x) == '\n') || ((x) == '\0'))
 
+#if TINYOBJ_SIMD_WIDTH
+	static inline unsigned int firstSetBit(unsigned int mask) {
+#ifdef _MSC_VER
+		unsigned long idx;
+		_BitScanForward(&idx, mask);
+		return static_cast<unsigned int>(idx);
+#else
+		return static_cast<unsigned int>(__builtin_ctz(mask));
+#endif
+	}
+
+#if TINYOBJ_SIMD_WIDTH == 32
+	// Bit i is set when block[i] is in '0'..'9'.
+	static inline unsigned int simdDigitMask(const char *block) {
+		__m256i c = _mm256_load_si256(reinterpret_cast<const __m256i *>(block));
+		__m256i d = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+		__m256i le9 = _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+		return static_cast<unsigned int>(_mm256_movemask_epi8(le9));
+	}
+
+	// Bit i is set when block[i] is one of ' ', '\t', '\r' or '\0'.
+	static inline unsigned int simdTokenEndMask(const char *block) {
+		__m256i c = _mm256_load_si256(reinterpret_cast<const __m256i *>(block));
+		__m256i m = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(' ')),
+				_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\t'))),
+			_mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\r')),
+				_mm256_cmpeq_epi8(c, _mm256_setzero_si256())));
+		return static_cast<unsigned int>(_mm256_movemask_epi8(m));
+	}
+#else
+	static inline unsigned int simdDigitMask(const char *block) {
+		__m128i c = _mm_load_si128(reinterpret_cast<const __m128i *>(block));
+		__m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+		__m128i le9 = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+		return static_cast<unsigned int>(_mm_movemask_epi8(le9));
+	}
+
+	static inline unsigned int simdTokenEndMask(const char *block) {
+		__m128i c = _mm_load_si128(reinterpret_cast<const __m128i *>(block));
+		__m128i m = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')),
+				_mm_cmpeq_epi8(c, _mm_set1_epi8('\t'))),
+			_mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('\r')),
+				_mm_cmpeq_epi8(c, _mm_setzero_si128())));
+		return static_cast<unsigned int>(_mm_movemask_epi8(m));
+	}
+#endif
+
+	// Returns the offset of the first byte in [p, p + max_len) that is not a
+	// digit (kDigits) or that ends a token (!kDigits), or max_len.
+	//
+	// Blocks are loaded aligned so a load never crosses into the next page,
+	// the bytes around [p, p + max_len) it reads are masked off.
+	template <bool kDigits>
+	static inline size_t simdScan(const char *p, size_t max_len) {
+		size_t n = 0;
+		while (n < max_len) {
+			const char *q = p + n;
+			size_t offset = static_cast<size_t>(
+				reinterpret_cast<uintptr_t>(q) & (TINYOBJ_SIMD_WIDTH - 1));
+			const char *block = q - offset;
+			unsigned int mask = kDigits ? ~simdDigitMask(block) : simdTokenEndMask(block);
+			mask >>= offset;
+			size_t avail = TINYOBJ_SIMD_WIDTH - offset;
+			if (max_len - n < avail) {
+				avail = max_len - n;
+			}
+			if (avail < 32) {
+				mask &= (1u << avail) - 1;
+			}
+			if (mask) {
+				return n + firstSetBit(mask);
+			}
+			n += avail;
+		}
+		return max_len;
+	}
+#endif
+
+	// Number of consecutive digits at p, looking at most max_len bytes.
+	static inline size_t countDigits(const char *p, size_t max_len) {
+#if TINYOBJ_SIMD_WIDTH
+		return simdScan<true>(p, max_len);
+#else
+		size_t n = 0;
+		while (n < max_len && IS_DIGIT(p[n])) n++;
+		return n;
+#endif
+	}
+
+	// Same as strcspn(p, " \t\r").
+	static inline size_t tokenLength(const char *p) {
+#if TINYOBJ_SIMD_WIDTH
+		return simdScan<false>(p, static_cast<size_t>(-1));
+#else
+		return strcspn(p, " \t\r");
+#endif
+	}
+
+	// Value of the n digits at p, n must be at most 19.
+	static inline unsigned long long parseDigits(const char *p, size_t n) {
+		unsigned long long value = 0;
+#if TINYOBJ_SIMD_WIDTH
+		// x86 is little endian, so the first digit is the low byte and eight
+		// digits can be combined pairwise in three multiplies
+		while (n >= 8) {
+			unsigned long long chunk;
+			memcpy(&chunk, p, 8);
+			chunk -= 0x3030303030303030ULL;
+			chunk = (chunk * 10 + (chunk >> 8)) & 0x00FF00FF00FF00FFULL;
+			chunk = (chunk * 100 + (chunk >> 16)) & 0x0000FFFF0000FFFFULL;
+			chunk = (chunk * 10000 + (chunk >> 32)) & 0x00000000FFFFFFFFULL;
+			value = value * 100000000ULL + chunk;
+			p += 8;
+			n -= 8;
+		}
+#endif
+		while (n--) {
+			value = value * 10 + static_cast<unsigned int>(*p++ - '0');
+		}
+		return value;
+	}
+
+	// Same as atoi(p) but reports where the number ended in *end.
+	static inline int fastAtoi(const char *p, const char **end) {
+		while (*p == ' ' || (*p >= '\t' && *p <= '\r')) p++;
+		const char *start = p;
+		bool negative = false;
+		if (*p == '+' || *p == '-') {
+			negative = *p == '-';
+			p++;
+		}
+		size_t digits = countDigits(p, static_cast<size_t>(-1));
+		if (digits > 9) {
+			// let atoi deal with values that might not fit
+			*end = p + digits;
+			return atoi(start);
+		}
+		int value = static_cast<int>(parseDigits(p, digits));
+		*end = p + digits;
+		return negative ? -value : value;
+	}
+
+	// Parses the index at *token like atoi and advances *token the way
+	// strcspn(*token, "/ \t\r") would.
+	static inline int parseIndexToken(const char **token) {
+		const char *end;
+		int value = fastAtoi((*token), &end);
+		char first = (*token)[0];
+		char c = *end;
+		bool skipped_space = first == ' ' || (first >= '\t' && first <= '\r');
+		if (!skipped_space &&
+			(c == '/' || c == ' ' || c == '\t' || c == '\r' || c == '\0')) {
+			(*token) = end;
+		}
+		else {
+			(*token) += strcspn((*token), "/ \t\r");
+		}
+		return value;
+	}
+
 	// Make index zero-base, and also support relative index.
 	static inline int fixIndex(int idx, int n) {
 		if (idx > 0) return idx - 1;
@@ -425,8 +605,9 @@ namespace tinyobj {
 
 	static inline int parseInt(const char **token) {
 		(*token) += strspn((*token), " \t");
-		int i = atoi((*token));
-		(*token) += strcspn((*token), " \t\r");
+		const char *end;
+		int i = fastAtoi((*token), &end);
+		(*token) += tokenLength((*token));
 		return i;
 	}
 
@@ -457,7 +638,7 @@ namespace tinyobj {
 	//  - s >= s_end.
 	//  - parse failure.
 	//
-	static bool tryParseDouble(const char *s, const char *s_end, double *result) {
+	static bool tryParseDoubleScalar(const char *s, const char *s_end, double *result) {
 		if (s >= s_end) {
 			return false;
 		}
@@ -578,9 +759,91 @@ namespace tinyobj {
 		return false;
 	}
 
+	// Same grammar and greedy behaviour as tryParseDoubleScalar.
+	//
+	// Digit runs are found with countDigits and converted as integers, then
+	// plain decimals with at most 19 digits and a mantissa below 2^53 are
+	// assembled with one exact divide by a power of ten. Everything else goes
+	// through tryParseDoubleScalar.
+	static bool tryParseDouble(const char *s, const char *s_end, double *result) {
+		static const double exact_pow10[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+		};
+
+		if (s >= s_end) {
+			return false;
+		}
+
+		const char *curr = s;
+		bool negative = false;
+		if (*curr == '+' || *curr == '-') {
+			negative = *curr == '-';
+			curr++;
+		}
+
+		const char *int_part = curr;
+		size_t int_digits = countDigits(curr, static_cast<size_t>(s_end - curr));
+		if (int_digits == 0) {
+			return false;
+		}
+		curr += int_digits;
+
+		const char *frac_part = curr;
+		size_t frac_digits = 0;
+		if (curr != s_end && *curr == '.') {
+			frac_part = ++curr;
+			frac_digits = countDigits(curr, static_cast<size_t>(s_end - curr));
+			curr += frac_digits;
+		}
+
+		if (curr != s_end && (*curr == 'e' || *curr == 'E')) {
+			curr++;
+			if (curr != s_end && (*curr == '+' || *curr == '-')) {
+				curr++;
+			}
+			if (countDigits(curr, static_cast<size_t>(s_end - curr)) == 0) {
+				// Empty E is not allowed.
+				return false;
+			}
+			// the scalar parser scales by 5^e and 2^e separately, which
+			// doesn't always round like an exact conversion, so keep its
+			// results for explicit exponents
+			return tryParseDoubleScalar(s, s_end, result);
+		}
+
+		if (int_digits + frac_digits > 19) {
+			return tryParseDoubleScalar(s, s_end, result);
+		}
+		unsigned long long mantissa = parseDigits(int_part, int_digits);
+		if (frac_digits) {
+			mantissa = mantissa * static_cast<unsigned long long>(exact_pow10[frac_digits]) +
+				parseDigits(frac_part, frac_digits);
+		}
+		if (mantissa > (1ULL << 53)) {
+			return tryParseDoubleScalar(s, s_end, result);
+		}
+
+		// int_digits + frac_digits <= 19 so frac_digits is always in the table
+		double value = static_cast<double>(mantissa) / exact_pow10[frac_digits];
+
+		// The scalar parser accumulates the fraction with an error of a few
+		// ulps, which only changes the rounded float when the value is very
+		// close to halfway between two floats. Leave those to it so the
+		// floats stay bit-identical.
+		unsigned long long bits;
+		memcpy(&bits, &value, sizeof(bits));
+		unsigned long long below_float = bits & 0x1FFFFFFFULL;
+		if (below_float > 0x10000000ULL - 64 && below_float < 0x10000000ULL + 64) {
+			return tryParseDoubleScalar(s, s_end, result);
+		}
+		*result = negative ? -value : value;
+		return true;
+	}
+
 	static inline float parseFloat(const char **token, double default_value = 0.0) {
 		(*token) += strspn((*token), " \t");
-		const char *end = (*token) + strcspn((*token), " \t\r");
+		const char *end = (*token) + tokenLength((*token));
 		double val = default_value;
 		tryParseDouble((*token), end, &val);
 		float f = static_cast<float>(val);
@@ -691,8 +954,7 @@ namespace tinyobj {
 		int vtsize) {
 		vertex_index vi(-1);
 
-		vi.v_idx = fixIndex(atoi((*token)), vsize);
-		(*token) += strcspn((*token), "/ \t\r");
+		vi.v_idx = fixIndex(parseIndexToken(token), vsize);
 		if ((*token)[0] != '/') {
 			return vi;
 		}
@@ -701,22 +963,19 @@ namespace tinyobj {
 		// i//k
 		if ((*token)[0] == '/') {
 			(*token)++;
-			vi.vn_idx = fixIndex(atoi((*token)), vnsize);
-			(*token) += strcspn((*token), "/ \t\r");
+			vi.vn_idx = fixIndex(parseIndexToken(token), vnsize);
 			return vi;
 		}
 
 		// i/j/k or i/j
-		vi.vt_idx = fixIndex(atoi((*token)), vtsize);
-		(*token) += strcspn((*token), "/ \t\r");
+		vi.vt_idx = fixIndex(parseIndexToken(token), vtsize);
 		if ((*token)[0] != '/') {
 			return vi;
 		}
 
 		// i/j/k
 		(*token)++;  // skip '/'
-		vi.vn_idx = fixIndex(atoi((*token)), vnsize);
-		(*token) += strcspn((*token), "/ \t\r");
+		vi.vn_idx = fixIndex(parseIndexToken(token), vnsize);
 		return vi;
 	}
 
@@ -724,8 +983,7 @@ namespace tinyobj {
 	static vertex_index parseRawTriple(const char **token) {
 		vertex_index vi(static_cast<int>(0));  // 0 is an invalid index in OBJ
 
-		vi.v_idx = atoi((*token));
-		(*token) += strcspn((*token), "/ \t\r");
+		vi.v_idx = parseIndexToken(token);
 		if ((*token)[0] != '/') {
 			return vi;
 		}
@@ -734,22 +992,19 @@ namespace tinyobj {
 		// i//k
 		if ((*token)[0] == '/') {
 			(*token)++;
-			vi.vn_idx = atoi((*token));
-			(*token) += strcspn((*token), "/ \t\r");
+			vi.vn_idx = parseIndexToken(token);
 			return vi;
 		}
 
 		// i/j/k or i/j
-		vi.vt_idx = atoi((*token));
-		(*token) += strcspn((*token), "/ \t\r");
+		vi.vt_idx = parseIndexToken(token);
 		if ((*token)[0] != '/') {
 			return vi;
 		}
 
 		// i/j/k
 		(*token)++;  // skip '/'
-		vi.vn_idx = atoi((*token));
-		(*token) += strcspn((*token), "/ \t\r");
+		vi.vn_idx = parseIndexToken(token);
 		return vi;
 	}
 
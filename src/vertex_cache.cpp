@@ -0,0 +1,226 @@
+#include "vertex_cache.h"
+
+VertexCacheStats analyzeVertexCache(const std::vector<uint32>& triangles, uint32 vertexCount, uint32 cacheSize)
+{
+	VertexCacheStats stats = {};
+	size_t triCount = triangles.size() / 3;
+	if (triCount == 0) {
+		return stats;
+	}
+
+	// a vertex is in the fifo while fewer than cacheSize misses happened
+	// since it was loaded
+	std::vector<uint32> loadedAt(vertexCount, 0);
+	std::vector<uint8_t> used(vertexCount, 0);
+	uint32 misses = 0;
+	uint32 usedCount = 0;
+	for (size_t i = 0; i < triCount * 3; ++i) {
+		uint32 v = triangles[i];
+		if (v >= vertexCount) {
+			continue;
+		}
+		if (!used[v] || misses - loadedAt[v] >= cacheSize) {
+			usedCount += !used[v];
+			used[v] = 1;
+			misses++;
+			loadedAt[v] = misses;
+		}
+	}
+	stats.acmr = (float)misses / triCount;
+	stats.atvr = usedCount ? (float)misses / usedCount : 0.0f;
+	return stats;
+}
+
+namespace {
+
+const uint32 noVertex = 0xFFFFFFFF;
+
+struct TipsifyState
+{
+	// triangles using each vertex, as offsets into adjacency
+	std::vector<uint32> adjacencyStarts;
+	std::vector<uint32> adjacency;
+	// triangles using each vertex that haven't been emitted yet
+	std::vector<uint32> live;
+	std::vector<uint32> cacheTime;
+	std::vector<uint32> deadEnds;
+	uint32 time;
+	uint32 cursor;
+};
+
+/**
+ * Picks the vertex to fan around next: a candidate that will still be in
+ * the cache after its remaining triangles are emitted, preferring the
+ * oldest, or failing that a recently used vertex with triangles left, or
+ * failing that the next vertex in input order with triangles left.
+ */
+uint32 nextVertex(TipsifyState& state, const std::vector<uint32>& candidates, uint32 cacheSize)
+{
+	uint32 best = noVertex;
+	uint32 bestPriority = 0;
+	for (size_t i = 0; i < candidates.size(); ++i) {
+		uint32 v = candidates[i];
+		if (state.live[v] == 0) {
+			continue;
+		}
+		uint32 age = state.time - state.cacheTime[v];
+		uint32 priority = age + 2 * state.live[v] <= cacheSize ? age + 1 : 0;
+		if (best == noVertex || priority > bestPriority) {
+			best = v;
+			bestPriority = priority;
+		}
+	}
+	if (best != noVertex) {
+		return best;
+	}
+
+	while (!state.deadEnds.empty()) {
+		uint32 v = state.deadEnds.back();
+		state.deadEnds.pop_back();
+		if (state.live[v] > 0) {
+			return v;
+		}
+	}
+
+	uint32 vertexCount = (uint32)state.live.size();
+	while (state.cursor < vertexCount) {
+		uint32 v = state.cursor++;
+		if (state.live[v] > 0) {
+			return v;
+		}
+	}
+	return noVertex;
+}
+
+} // namespace
+
+void optimizeVertexCache(std::vector<uint32>& triangles, uint32 vertexCount, uint32 cacheSize)
+{
+	uint32 triCount = (uint32)(triangles.size() / 3);
+	if (triCount == 0 || vertexCount == 0) {
+		return;
+	}
+
+	TipsifyState state;
+	state.live.assign(vertexCount, 0);
+	std::vector<uint8_t> emitted(triCount, 0);
+	std::vector<uint32> invalid;
+	for (uint32 t = 0; t < triCount; ++t) {
+		const uint32* tri = &triangles[t * 3];
+		if (tri[0] >= vertexCount || tri[1] >= vertexCount || tri[2] >= vertexCount) {
+			emitted[t] = 1;
+			invalid.push_back(t);
+			continue;
+		}
+		state.live[tri[0]]++;
+		state.live[tri[1]]++;
+		state.live[tri[2]]++;
+	}
+
+	state.adjacencyStarts.resize(vertexCount + 1);
+	state.adjacencyStarts[0] = 0;
+	for (uint32 v = 0; v < vertexCount; ++v) {
+		state.adjacencyStarts[v + 1] = state.adjacencyStarts[v] + state.live[v];
+	}
+	state.adjacency.resize(state.adjacencyStarts[vertexCount]);
+	std::vector<uint32> fill(state.adjacencyStarts.begin(), state.adjacencyStarts.end() - 1);
+	for (uint32 t = 0; t < triCount; ++t) {
+		if (emitted[t]) {
+			continue;
+		}
+		for (int k = 0; k < 3; ++k) {
+			uint32 v = triangles[t * 3 + k];
+			state.adjacency[fill[v]++] = t;
+		}
+	}
+
+	// cache times start far enough in the past that nothing is cached
+	state.cacheTime.assign(vertexCount, 0);
+	state.time = cacheSize + 1;
+	state.cursor = 0;
+
+	std::vector<uint32> output;
+	output.reserve(triangles.size());
+	std::vector<uint32> candidates;
+	uint32 fan = 0;
+	while (fan != noVertex) {
+		candidates.clear();
+		// emit every remaining triangle around the fan vertex
+		for (uint32 a = state.adjacencyStarts[fan]; a < state.adjacencyStarts[fan + 1]; ++a) {
+			uint32 t = state.adjacency[a];
+			if (emitted[t]) {
+				continue;
+			}
+			emitted[t] = 1;
+			for (int k = 0; k < 3; ++k) {
+				uint32 v = triangles[t * 3 + k];
+				output.push_back(v);
+				state.deadEnds.push_back(v);
+				candidates.push_back(v);
+				state.live[v]--;
+				if (state.time - state.cacheTime[v] > cacheSize) {
+					state.cacheTime[v] = state.time++;
+				}
+			}
+		}
+		fan = nextVertex(state, candidates, cacheSize);
+	}
+
+	for (size_t i = 0; i < invalid.size(); ++i) {
+		const uint32* tri = &triangles[invalid[i] * 3];
+		output.insert(output.end(), tri, tri + 3);
+	}
+	triangles.swap(output);
+}
+
+uint32 optimizeVertexFetch(std::vector<uint32>& triangles, std::vector<Vertex>& verts,
+	std::vector<uint32>* lodTriangles)
+{
+	const uint32 noVertex = ~0u;
+	uint32 vertexCount = (uint32)verts.size();
+
+	// out of range indices stay as they are, they're still out of range
+	// after the vertex count shrinks, but the whole triangle is skipped so
+	// its valid corners don't keep vertices alive either
+	std::vector<uint32> remap(vertexCount, noVertex);
+	uint32 used = 0;
+	auto remapTriangles = [&](std::vector<uint32>& indices) {
+		uint32 triCount = (uint32)(indices.size() / 3);
+		for (uint32 t = 0; t < triCount; ++t) {
+			uint32* tri = &indices[t * 3];
+			if (tri[0] >= vertexCount || tri[1] >= vertexCount || tri[2] >= vertexCount) {
+				continue;
+			}
+			for (int k = 0; k < 3; ++k) {
+				uint32& slot = remap[tri[k]];
+				if (slot == noVertex) {
+					slot = used++;
+				}
+				tri[k] = slot;
+			}
+		}
+	};
+	remapTriangles(triangles);
+	if (lodTriangles) {
+		remapTriangles(*lodTriangles);
+	}
+
+	if (used == vertexCount) {
+		// nothing to copy when the vertices are already in first use order
+		bool identity = true;
+		for (uint32 v = 0; identity && v < vertexCount; ++v) {
+			identity = remap[v] == v;
+		}
+		if (identity) {
+			return 0;
+		}
+	}
+	std::vector<Vertex> output(used);
+	for (uint32 v = 0; v < vertexCount; ++v) {
+		if (remap[v] != noVertex) {
+			output[remap[v]] = verts[v];
+		}
+	}
+	verts.swap(output);
+	return vertexCount - used;
+}
@@ -0,0 +1,47 @@
+#ifndef VERTEX_CACHE_H
+#define VERTEX_CACHE_H
+
+#include "main.h"
+
+#include <vector>
+
+// post-transform cache size assumed when none is given, a typical fifo
+// size for desktop gpus
+const uint32 defaultVertexCacheSize = 16;
+
+struct VertexCacheStats
+{
+	// average cache miss ratio, vertex shader runs per triangle (0.5 - 3)
+	float acmr;
+	// average transform to vertex ratio, vertex shader runs per vertex
+	// the triangles use (1 is optimal)
+	float atvr;
+};
+
+/**
+ * @brief Simulates a fifo post-transform cache of cacheSize entries
+ * running over triangles.
+ */
+VertexCacheStats analyzeVertexCache(const std::vector<uint32>& triangles, uint32 vertexCount,
+	uint32 cacheSize = defaultVertexCacheSize);
+
+/**
+ * @brief Reorders triangles for post-transform cache hits with Tipsify
+ * (Sander, Nehab and Barczak 2007), which runs in linear time. Triangles
+ * with out of range indices are moved to the end in their original order.
+ */
+void optimizeVertexCache(std::vector<uint32>& triangles, uint32 vertexCount,
+	uint32 cacheSize = defaultVertexCacheSize);
+
+/**
+ * @brief Renumbers verts in the order triangles first use them so vertex
+ * fetches stream through the buffer, and drops vertices no triangle uses.
+ * Meant to run last, once the triangle order is final. The indices are
+ * remapped in place in the same pass that builds the new order.
+ * lodTriangles are remapped as well, anything only they use goes last.
+ * @return the number of vertices dropped
+ */
+uint32 optimizeVertexFetch(std::vector<uint32>& triangles, std::vector<Vertex>& verts,
+	std::vector<uint32>* lodTriangles = 0);
+
+#endif // VERTEX_CACHE_H
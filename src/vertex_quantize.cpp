@@ -0,0 +1,282 @@
+#include "vertex_quantize.h"
+#include "mesh_bounds.h"
+
+#include "glm/common.hpp"
+#include "glm/geometric.hpp"
+#include "glm/packing.hpp"
+#include "glm/trigonometric.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#ifdef VERTEX_STREAMS_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef VERTEX_STREAMS_AVX2
+#include <immintrin.h>
+#endif
+
+static_assert(sizeof(QuantizedVertex) == 12, "QuantizedVertex should be 12 bytes");
+static_assert(sizeof(QuantizedTangentSpace) == 8, "QuantizedTangentSpace should be 8 bytes");
+
+// the shader's decodeNormal, see phongvertshader.vert
+static glm::vec3 decodeOctahedral(const uint16_t normal[2])
+{
+	glm::vec3 n(normal[0] / 65535.0f * 2.0f - 1.0f, normal[1] / 65535.0f * 2.0f - 1.0f, 0.0f);
+	n.z = 1.0f - std::fabs(n.x) - std::fabs(n.y);
+	float32 t = std::max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return glm::normalize(n);
+}
+
+static bool hasTexCoords(const std::vector<Vertex>& verts)
+{
+	for (size_t i = 0; i < verts.size(); ++i) {
+		if (verts[i].texCoord != glm::vec2(0.0f)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void quantizeTangentSpace(const std::vector<Vertex>& verts, std::vector<QuantizedTangentSpace>& out)
+{
+	out.resize(verts.size());
+	for (size_t i = 0; i < verts.size(); ++i) {
+		uint32 texCoord = glm::packHalf2x16(verts[i].texCoord);
+		out[i].tangent = verts[i].tangent;
+		out[i].texCoord[0] = (uint16_t)texCoord;
+		out[i].texCoord[1] = (uint16_t)(texCoord >> 16);
+	}
+}
+
+#ifndef VERTEX_STREAMS_SSE2
+static inline uint16_t quantizeUnorm16(float32 v)
+{
+	return (uint16_t)(std::max(0.0f, std::min(v, 1.0f)) * 65535.0f + 0.5f);
+}
+
+static void quantizeVertex(const glm::vec3& location, const glm::vec3& n, const glm::vec3& offset,
+	const glm::vec3& invScale, QuantizedVertex& q)
+{
+	for (int i = 0; i < 3; ++i) {
+		q.position[i] = quantizeUnorm16((location[i] - offset[i]) * invScale[i]);
+	}
+
+	// project onto the octahedron and fold the lower half over the upper
+	float32 l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+	float32 inv = l1 > 0.0f ? 1.0f / l1 : 0.0f;
+	float32 x = n.x * inv;
+	float32 y = n.y * inv;
+	if (n.z < 0.0f) {
+		float32 fx = (1.0f - std::fabs(y)) * std::copysign(1.0f, x);
+		float32 fy = (1.0f - std::fabs(x)) * std::copysign(1.0f, y);
+		x = fx;
+		y = fy;
+	}
+	q.normal[0] = quantizeUnorm16(x * 0.5f + 0.5f);
+	q.normal[1] = quantizeUnorm16(y * 0.5f + 0.5f);
+}
+#endif
+
+/**
+ * Writes the lanes of a batch starting at vertex first out as quantized
+ * vertices, values holds the three position and two normal components per
+ * lane. Lanes of the padding are dropped.
+ */
+static void storeBatch(const uint32 values[5][vertexStreamBatch], size_t first, size_t lanes, size_t count,
+	QuantizedVertex* out)
+{
+	for (size_t k = 0; k < lanes && first + k < count; ++k) {
+		QuantizedVertex& q = out[first + k];
+		q.position[0] = (uint16_t)values[0][k];
+		q.position[1] = (uint16_t)values[1][k];
+		q.position[2] = (uint16_t)values[2][k];
+		q.padding = 0;
+		q.normal[0] = (uint16_t)values[3][k];
+		q.normal[1] = (uint16_t)values[4][k];
+	}
+}
+
+#ifdef VERTEX_STREAMS_SSE2
+/**
+ * Quantizes four vertices at a time, every lane is a vertex.
+ */
+static void quantizeStreamsSse2(const VertexStreams& streams, const glm::vec3& offset, const glm::vec3& invScale,
+	QuantizedVertex* out)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	const __m128 unormMax = _mm_set1_ps(65535.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 offsets[3] = { _mm_set1_ps(offset.x), _mm_set1_ps(offset.y), _mm_set1_ps(offset.z) };
+	const __m128 scales[3] = {
+		_mm_set1_ps(invScale.x * 65535.0f), _mm_set1_ps(invScale.y * 65535.0f), _mm_set1_ps(invScale.z * 65535.0f) };
+
+	uint32 values[5][vertexStreamBatch];
+	for (size_t i = 0; i < streams.paddedCount; i += 4) {
+		for (int a = 0; a < 3; ++a) {
+			__m128 p = _mm_load_ps(streams.location[a] + i);
+			__m128 q = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(p, offsets[a]), scales[a]), half);
+			q = _mm_min_ps(_mm_max_ps(q, zero), _mm_add_ps(unormMax, half));
+			_mm_storeu_si128((__m128i*)values[a], _mm_cvttps_epi32(q));
+		}
+
+		__m128 n0 = _mm_load_ps(streams.normal[0] + i);
+		__m128 n1 = _mm_load_ps(streams.normal[1] + i);
+		__m128 n2 = _mm_load_ps(streams.normal[2] + i);
+		__m128 ax = _mm_andnot_ps(signBit, n0);
+		__m128 ay = _mm_andnot_ps(signBit, n1);
+		__m128 az = _mm_andnot_ps(signBit, n2);
+		__m128 l1 = _mm_add_ps(_mm_add_ps(ax, ay), az);
+		__m128 valid = _mm_cmpgt_ps(l1, zero);
+		__m128 inv = _mm_and_ps(valid, _mm_div_ps(one, _mm_max_ps(l1, _mm_set1_ps(FLT_MIN))));
+		__m128 x = _mm_mul_ps(n0, inv);
+		__m128 y = _mm_mul_ps(n1, inv);
+		__m128 signX = _mm_or_ps(_mm_and_ps(x, signBit), one);
+		__m128 signY = _mm_or_ps(_mm_and_ps(y, signBit), one);
+		__m128 foldX = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(signBit, y)), signX);
+		__m128 foldY = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(signBit, x)), signY);
+		__m128 lower = _mm_cmplt_ps(n2, zero);
+		x = _mm_or_ps(_mm_and_ps(lower, foldX), _mm_andnot_ps(lower, x));
+		y = _mm_or_ps(_mm_and_ps(lower, foldY), _mm_andnot_ps(lower, y));
+		__m128 e[2] = { x, y };
+		for (int a = 0; a < 2; ++a) {
+			__m128 q = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(e[a], half), half), unormMax), half);
+			q = _mm_min_ps(_mm_max_ps(q, zero), _mm_add_ps(unormMax, half));
+			_mm_storeu_si128((__m128i*)values[3 + a], _mm_cvttps_epi32(q));
+		}
+		storeBatch(values, i, 4, streams.count, out);
+	}
+}
+#endif
+
+#ifdef VERTEX_STREAMS_AVX2
+/**
+ * Same as quantizeStreamsSse2, eight vertices at a time.
+ */
+AVX2_FUNCTION static void quantizeStreamsAvx2(const VertexStreams& streams, const glm::vec3& offset,
+	const glm::vec3& invScale, QuantizedVertex* out)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+	const __m256 unormMax = _mm256_set1_ps(65535.0f);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 offsets[3] = { _mm256_set1_ps(offset.x), _mm256_set1_ps(offset.y), _mm256_set1_ps(offset.z) };
+	const __m256 scales[3] = {
+		_mm256_set1_ps(invScale.x * 65535.0f), _mm256_set1_ps(invScale.y * 65535.0f), _mm256_set1_ps(invScale.z * 65535.0f) };
+
+	uint32 values[5][vertexStreamBatch];
+	for (size_t i = 0; i < streams.paddedCount; i += vertexStreamBatch) {
+		for (int a = 0; a < 3; ++a) {
+			__m256 p = _mm256_load_ps(streams.location[a] + i);
+			__m256 q = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(p, offsets[a]), scales[a]), half);
+			q = _mm256_min_ps(_mm256_max_ps(q, zero), _mm256_add_ps(unormMax, half));
+			_mm256_storeu_si256((__m256i*)values[a], _mm256_cvttps_epi32(q));
+		}
+
+		__m256 n0 = _mm256_load_ps(streams.normal[0] + i);
+		__m256 n1 = _mm256_load_ps(streams.normal[1] + i);
+		__m256 n2 = _mm256_load_ps(streams.normal[2] + i);
+		__m256 ax = _mm256_andnot_ps(signBit, n0);
+		__m256 ay = _mm256_andnot_ps(signBit, n1);
+		__m256 az = _mm256_andnot_ps(signBit, n2);
+		__m256 l1 = _mm256_add_ps(_mm256_add_ps(ax, ay), az);
+		__m256 valid = _mm256_cmp_ps(l1, zero, _CMP_GT_OQ);
+		__m256 inv = _mm256_and_ps(valid, _mm256_div_ps(one, _mm256_max_ps(l1, _mm256_set1_ps(FLT_MIN))));
+		__m256 x = _mm256_mul_ps(n0, inv);
+		__m256 y = _mm256_mul_ps(n1, inv);
+		__m256 signX = _mm256_or_ps(_mm256_and_ps(x, signBit), one);
+		__m256 signY = _mm256_or_ps(_mm256_and_ps(y, signBit), one);
+		__m256 foldX = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_andnot_ps(signBit, y)), signX);
+		__m256 foldY = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_andnot_ps(signBit, x)), signY);
+		__m256 lower = _mm256_cmp_ps(n2, zero, _CMP_LT_OQ);
+		x = _mm256_blendv_ps(x, foldX, lower);
+		y = _mm256_blendv_ps(y, foldY, lower);
+		__m256 e[2] = { x, y };
+		for (int a = 0; a < 2; ++a) {
+			__m256 q = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(e[a], half), half), unormMax), half);
+			q = _mm256_min_ps(_mm256_max_ps(q, zero), _mm256_add_ps(unormMax, half));
+			_mm256_storeu_si256((__m256i*)values[3 + a], _mm256_cvttps_epi32(q));
+		}
+		storeBatch(values, i, vertexStreamBatch, streams.count, out);
+	}
+}
+#endif
+
+void quantizeVertices(Mesh& mesh, QuantizationStats* stats)
+{
+	VertexStreams streams = {};
+	buildVertexStreams(streams, mesh.verts.data(), mesh.verts.size());
+	quantizeVertices(mesh, streams, stats);
+	freeVertexStreams(streams);
+}
+
+void quantizeVertices(Mesh& mesh, const VertexStreams& streams, QuantizationStats* stats)
+{
+	uint32 count = (uint32)mesh.verts.size();
+	if (!mesh.hasBounds) {
+		computeBounds(streams, mesh.bounds);
+		mesh.hasBounds = true;
+	}
+	glm::vec3 minBounds = mesh.bounds.boxMin;
+	glm::vec3 maxBounds = mesh.bounds.boxMax;
+	glm::vec3 extent = maxBounds - minBounds;
+	glm::vec3 invScale;
+	for (int a = 0; a < 3; ++a) {
+		invScale[a] = extent[a] > 0.0f ? 1.0f / extent[a] : 0.0f;
+	}
+	mesh.quantizedOffset = minBounds;
+	mesh.quantizedScale = extent;
+	mesh.quantizedVerts.resize(count);
+
+#ifdef VERTEX_STREAMS_AVX2
+	if (useAvx2()) {
+		quantizeStreamsAvx2(streams, minBounds, invScale, mesh.quantizedVerts.data());
+	}
+	else
+#endif
+	{
+#ifdef VERTEX_STREAMS_SSE2
+		quantizeStreamsSse2(streams, minBounds, invScale, mesh.quantizedVerts.data());
+#else
+		for (uint32 i = 0; i < count; ++i) {
+			QuantizedVertex& q = mesh.quantizedVerts[i];
+			quantizeVertex(streamLocation(streams, i), streamNormal(streams, i), minBounds, invScale, q);
+			q.padding = 0;
+		}
+#endif
+	}
+	if (hasTexCoords(mesh.verts)) {
+		quantizeTangentSpace(mesh.verts, mesh.quantizedTangentSpace);
+	}
+	else {
+		mesh.quantizedTangentSpace.clear();
+	}
+
+	if (!stats) {
+		return;
+	}
+	stats->positionErrorBound = std::max(extent.x, std::max(extent.y, extent.z)) * 0.5f / 65535.0f;
+	stats->positionError = 0.0f;
+	stats->normalErrorDegrees = 0.0f;
+	for (uint32 i = 0; i < count; ++i) {
+		const Vertex& v = mesh.verts[i];
+		const QuantizedVertex& q = mesh.quantizedVerts[i];
+		for (int a = 0; a < 3; ++a) {
+			// in double so the float rounding of the check doesn't show up
+			double decoded = minBounds[a] + q.position[a] / 65535.0 * extent[a];
+			stats->positionError = std::max(stats->positionError, (float32)std::fabs(decoded - v.location[a]));
+		}
+		if (glm::dot(v.normal, v.normal) > 0.0f) {
+			// atan2 stays accurate for the tiny angles acos can't resolve
+			glm::vec3 decoded = decodeOctahedral(q.normal);
+			float32 angle = std::atan2(glm::length(glm::cross(v.normal, decoded)), glm::dot(v.normal, decoded));
+			stats->normalErrorDegrees = std::max(stats->normalErrorDegrees, glm::degrees(angle));
+		}
+	}
+}
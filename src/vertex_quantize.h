@@ -0,0 +1,39 @@
+#ifndef VERTEX_QUANTIZE_H
+#define VERTEX_QUANTIZE_H
+
+#include "main.h"
+#include "vertex_streams.h"
+
+#include <vector>
+
+struct QuantizationStats
+{
+	// worst position error any vertex can get, half a step along the
+	// longest axis of the bounding box (give or take float rounding), and
+	// the worst one measured
+	float32 positionErrorBound;
+	float32 positionError;
+	// worst measured angle between a normal and its decoded normal
+	float32 normalErrorDegrees;
+};
+
+/**
+ * @brief Fills mesh.quantizedVerts from mesh.verts, 12 instead of 36 bytes
+ * per vertex. Positions are stored relative to the mesh's bounding box in
+ * 16 bits per axis, normals are octahedral encoded (Cigolle et al. 2014)
+ * in 16 bits per component. The shader decodes them.
+ * Only meshes with texture coordinates also fill
+ * mesh.quantizedTangentSpace, 8 more bytes per vertex: tangents are
+ * already packed and are copied, texture coordinates become half floats.
+ * Without texture coordinates the tangents mean nothing and are dropped.
+ */
+void quantizeVertices(Mesh& mesh, QuantizationStats* stats = 0);
+
+/**
+ * @brief Same with streams already built from mesh.verts. The positions are
+ * quantized within mesh.bounds' box, which is computed first if the mesh
+ * has no bounds yet.
+ */
+void quantizeVertices(Mesh& mesh, const VertexStreams& streams, QuantizationStats* stats = 0);
+
+#endif // VERTEX_QUANTIZE_H
@@ -0,0 +1,54 @@
+#include "vertex_streams.h"
+#include "sdl.h"
+
+#include <xmmintrin.h>
+
+static const size_t streamAlignment = 32;
+
+void buildVertexStreams(VertexStreams& streams, const Vertex* verts, size_t count)
+{
+	freeVertexStreams(streams);
+	size_t padded = (count + vertexStreamBatch - 1) / vertexStreamBatch * vertexStreamBatch;
+	streams.count = count;
+	streams.paddedCount = padded;
+	if (!padded) {
+		return;
+	}
+	// padded is a multiple of 8 floats, so every stream stays 32 byte aligned
+	streams.memory = (float*)_mm_malloc(padded * 6 * sizeof(float), streamAlignment);
+	for (int a = 0; a < 3; ++a) {
+		streams.location[a] = streams.memory + padded * a;
+		streams.normal[a] = streams.memory + padded * (3 + a);
+	}
+	for (size_t i = 0; i < padded; ++i) {
+		const Vertex& v = verts[i < count ? i : count - 1];
+		for (int a = 0; a < 3; ++a) {
+			streams.location[a][i] = v.location[a];
+			streams.normal[a][i] = v.normal[a];
+		}
+	}
+}
+
+void freeVertexStreams(VertexStreams& streams)
+{
+	_mm_free(streams.memory);
+	streams = VertexStreams();
+}
+
+void interleaveVertexStreams(const VertexStreams& streams, Vertex* verts)
+{
+	for (size_t i = 0; i < streams.count; ++i) {
+		verts[i].location = streamLocation(streams, i);
+		verts[i].normal = streamNormal(streams, i);
+	}
+}
+
+bool useAvx2()
+{
+#ifdef VERTEX_STREAMS_AVX2
+	static const bool avx2 = SDL_HasAVX2() == SDL_TRUE;
+	return avx2;
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,71 @@
+#ifndef VERTEX_STREAMS_H
+#define VERTEX_STREAMS_H
+
+#include "main.h"
+
+// kernels process this many vertices per step, one avx register of floats
+const size_t vertexStreamBatch = 8;
+
+/**
+ * @brief Positions and normals of a mesh as separate x, y and z streams,
+ * the layout the cpu side kernels (bounds, quantization) work on.
+ *
+ * Mesh::verts stays the interleaved upload layout, streams are a working
+ * copy built once for all kernels of a mesh. Every stream is 32 byte
+ * aligned and padded to a multiple of vertexStreamBatch vertices with
+ * copies of the last vertex, so kernels run whole batches and never need a
+ * scalar tail. Padding doesn't change a min, max or farthest point.
+ */
+struct VertexStreams
+{
+	float* location[3];
+	float* normal[3];
+	size_t count;
+	size_t paddedCount;
+	// one allocation for all six streams
+	float* memory;
+};
+
+/**
+ * @brief Fills streams from count interleaved vertices, streams must be
+ * zero initialized or freed.
+ */
+void buildVertexStreams(VertexStreams& streams, const Vertex* verts, size_t count);
+void freeVertexStreams(VertexStreams& streams);
+
+/**
+ * @brief Writes the streams back out as interleaved vertices, only the
+ * location and normal of each vertex are touched.
+ */
+void interleaveVertexStreams(const VertexStreams& streams, Vertex* verts);
+
+inline glm::vec3 streamLocation(const VertexStreams& streams, size_t i)
+{
+	return glm::vec3(streams.location[0][i], streams.location[1][i], streams.location[2][i]);
+}
+
+inline glm::vec3 streamNormal(const VertexStreams& streams, size_t i)
+{
+	return glm::vec3(streams.normal[0][i], streams.normal[1][i], streams.normal[2][i]);
+}
+
+/**
+ * @brief Whether the avx2 kernels can run, checked once. They are compiled
+ * for avx2 on their own whatever the compiler flags, so the same binary
+ * still runs on cpus without it.
+ */
+bool useAvx2();
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VERTEX_STREAMS_SSE2 1
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VERTEX_STREAMS_AVX2 1
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define VERTEX_STREAMS_AVX2 1
+#define AVX2_FUNCTION
+#endif
+
+#endif // VERTEX_STREAMS_H